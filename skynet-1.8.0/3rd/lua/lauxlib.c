@@ -1126,76 +1126,114 @@ LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
 
 // use clonefunction
 
-#include "spinlock.h"
+#include "atomic.h"
+
+/*
+** The cache is read by every worker when a service is spawned, so the
+** lookup takes no lock: a fixed array of slots, each a singly linked list
+** that only grows at the head by CAS. Nodes are never freed (the protos
+** are never freed either), clearcache only detaches the lists.
+*/
+
+#define CACHE_SLOTS 4096
+
+struct codecache_node {
+	struct codecache_node *next;
+	const void *proto;
+	unsigned int hash;
+	char key[1];
+};
 
 struct codecache {
-	struct spinlock lock;
-	lua_State *L;
+	ATOM_POINTER slot[CACHE_SLOTS];
+	ATOM_SIZET hit;
+	ATOM_SIZET miss;
+	ATOM_SIZET bytes;
+	ATOM_SIZET count;
 };
 
 static struct codecache CC;
 
-static void
-clearcache(void) {
-	if (CC.L == NULL)
-		return;
-	SPIN_LOCK(&CC)
-		lua_close(CC.L);
-		CC.L = luaL_newstate();
-	SPIN_UNLOCK(&CC)
+static unsigned int
+keyhash(const char *key) {
+	unsigned int h = 2166136261u;
+	for (; *key; key++) {
+		h = (h ^ (unsigned char)*key) * 16777619u;
+	}
+	return h;
+}
+
+static const struct codecache_node *
+findnode(const struct codecache_node *n, const char *key, unsigned int h) {
+	for (; n; n = n->next) {
+		if (n->hash == h && strcmp(n->key, key) == 0)
+			return n;
+	}
+	return NULL;
 }
 
 static void
-init(void) {
-	CC.L = luaL_newstate();
+clearcache(void) {
+	int i;
+	for (i=0;i<CACHE_SLOTS;i++) {
+		ATOM_STORE(&CC.slot[i], 0);
+	}
+	ATOM_STORE(&CC.count, 0);
+	ATOM_STORE(&CC.bytes, 0);
 }
 
 LUALIB_API void
 luaL_initcodecache(void) {
-	SPIN_INIT(&CC);
+	int i;
+	for (i=0;i<CACHE_SLOTS;i++) {
+		ATOM_INIT(&CC.slot[i], 0);
+	}
+	ATOM_INIT(&CC.hit, 0);
+	ATOM_INIT(&CC.miss, 0);
+	ATOM_INIT(&CC.bytes, 0);
+	ATOM_INIT(&CC.count, 0);
 }
 
 static const void *
 load_proto(const char *key) {
-  lua_State *L;
-  const void * result;
-  if (CC.L == NULL)
+  unsigned int h = keyhash(key);
+  const struct codecache_node *n = (const struct codecache_node *)ATOM_LOAD(&CC.slot[h % CACHE_SLOTS]);
+  n = findnode(n, key, h);
+  if (n == NULL) {
+    ATOM_FINC(&CC.miss);
     return NULL;
-  SPIN_LOCK(&CC)
-    L = CC.L;
-    lua_pushstring(L, key);
-    lua_rawget(L, LUA_REGISTRYINDEX);
-    result = lua_touserdata(L, -1);
-    lua_pop(L, 1);
-  SPIN_UNLOCK(&CC)
-
-  return result;
+  }
+  ATOM_FINC(&CC.hit);
+  return n->proto;
 }
 
 static const void *
-save_proto(const char *key, const void * proto) {
-  lua_State *L;
-  const void * result = NULL;
-
-  SPIN_LOCK(&CC)
-    if (CC.L == NULL) {
-      init();
+save_proto(const char *key, const void * proto, size_t sz) {
+  unsigned int h = keyhash(key);
+  ATOM_POINTER *slot = &CC.slot[h % CACHE_SLOTS];
+  size_t len = strlen(key);
+  struct codecache_node *node = NULL;
+  for (;;) {
+    uintptr_t head = ATOM_LOAD(slot);
+    const struct codecache_node *n = findnode((const struct codecache_node *)head, key, h);
+    if (n) {
+      /* another worker saved it first */
+      free(node);
+      return n->proto;
     }
-    L = CC.L;
-    lua_pushstring(L, key);
-    lua_pushvalue(L, -1);
-    lua_rawget(L, LUA_REGISTRYINDEX);
-    result = lua_touserdata(L, -1); /* stack: key oldvalue */
-    if (result == NULL) {
-      lua_pop(L,1);
-      lua_pushlightuserdata(L, (void *)proto);
-      lua_rawset(L, LUA_REGISTRYINDEX);
-    } else {
-      lua_pop(L,2);
+    if (node == NULL) {
+      node = (struct codecache_node *)malloc(sizeof(*node) + len);
+      node->proto = proto;
+      node->hash = h;
+      memcpy(node->key, key, len + 1);
     }
-
-  SPIN_UNLOCK(&CC)
-  return result;
+    node->next = (struct codecache_node *)head;
+    if (ATOM_CAS_POINTER(slot, head, (uintptr_t)node)) {
+      ATOM_FINC(&CC.count);
+      ATOM_FADD(&CC.bytes, sz);
+      return NULL;
+    }
+  }
 }
 
 #define CACHE_OFF 0
@@ -1274,7 +1312,8 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
   }
   lua_sharefunction(eL, -1);
   proto = lua_topointer(eL, -1);
-  oldv = save_proto(filename, proto);
+  /* bytes is the memory of eL, which keeps the proto */
+  oldv = save_proto(filename, proto, lua_gc(eL, LUA_GCCOUNT, 0) * 1024 + lua_gc(eL, LUA_GCCOUNTB, 0));
   if (oldv) {
     lua_close(eL);
     lua_clonefunction(L, oldv);
@@ -1293,10 +1332,25 @@ cache_clear(lua_State *L) {
 	return 0;
 }
 
+static int
+cache_stat(lua_State *L) {
+	lua_createtable(L, 0, 4);
+	lua_pushinteger(L, ATOM_LOAD(&CC.hit));
+	lua_setfield(L, -2, "hit");
+	lua_pushinteger(L, ATOM_LOAD(&CC.miss));
+	lua_setfield(L, -2, "miss");
+	lua_pushinteger(L, ATOM_LOAD(&CC.count));
+	lua_setfield(L, -2, "count");
+	lua_pushinteger(L, ATOM_LOAD(&CC.bytes));
+	lua_setfield(L, -2, "bytes");
+	return 1;
+}
+
 LUAMOD_API int luaopen_cache(lua_State *L) {
 	luaL_Reg l[] = {
 		{ "clear", cache_clear },
 		{ "mode", cache_mode },
+		{ "stat", cache_stat },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
@@ -5,8 +5,10 @@
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "skynet.h"
+#include "lz4block.h"
 
 /*
 	uint32_t/string addr 
@@ -19,9 +21,29 @@
 		uint32_t next_session
  */
 
-#define TEMP_LENGTH 0x8200
 #define MULTI_PART 0x8000
 
+static int
+lpackage_len(lua_State *L) {
+	lua_pushinteger(L, lua_rawlen(L, 1));
+	return 1;
+}
+
+/*
+	A package is a userdata of the bytes on wire, the message is copied into it only once.
+	socket.write/lwrite send it as a raw pointer of lua_rawlen size.
+ */
+static uint8_t *
+new_package(lua_State *L, size_t sz) {
+	uint8_t * buf = lua_newuserdatauv(L, sz, 0);
+	if (luaL_newmetatable(L, "CLUSTER_PACKAGE")) {
+		lua_pushcfunction(L, lpackage_len);
+		lua_setfield(L, -2, "__len");
+	}
+	lua_setmetatable(L, -2);
+	return buf;
+}
+
 static void
 fill_uint32(uint8_t * buf, uint32_t n) {
 	buf[0] = n & 0xff;
@@ -37,6 +59,157 @@ fill_header(lua_State *L, uint8_t *buf, int sz) {
 	buf[1] = sz & 0xff;
 }
 
+static inline uint32_t
+unpack_uint32(const uint8_t * buf) {
+	return buf[0] | buf[1]<<8 | buf[2]<<16 | buf[3]<<24;
+}
+
+/*
+	The payload larger than the threshold is compressed by lz4 when it's worth :
+		DWORD size (uncompressed)
+		PADDING lz4 block
+	A compressor is created for each link, see clustersender.lua and clusteragent.lua
+ */
+#define COMPRESSED 0x20
+
+struct compressor {
+	uint32_t threshold;	// 0 : don't compress, but decompress
+	uint64_t compress;
+	uint64_t skip;	// the payloads can't be compressed
+	uint64_t raw;
+	uint64_t packed;
+	uint64_t decompress;
+	uint64_t decompress_raw;
+	uint64_t decompress_packed;
+	uint64_t time;	// nanoseconds spent in lz4
+};
+
+static uint64_t
+now_ns() {
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * 1000000000 + ti.tv_nsec;
+}
+
+static struct compressor *
+get_compressor(lua_State *L, int index) {
+	return (struct compressor *)luaL_testudata(L, index, "CLUSTER_COMPRESSOR");
+}
+
+// returns a new buffer of the compressed payload, or NULL if it doesn't save anything
+static char *
+compress_payload(struct compressor *c, const char * msg, uint32_t sz, uint32_t *csz) {
+	if (c == NULL || c->threshold == 0 || sz < c->threshold || sz > LZ4BLOCK_MAX_INPUT_SIZE)
+		return NULL;
+	uint64_t start = now_ns();
+	char * buf = skynet_malloc(sz);
+	// the capacity is less than sz, so lz4 gives up early when the payload is incompressible
+	int n = lz4block_compress(msg, buf + 4, (int)sz, (int)sz - 5);
+	c->time += now_ns() - start;
+	if (n <= 0) {
+		skynet_free(buf);
+		++c->skip;
+		return NULL;
+	}
+	fill_uint32((uint8_t *)buf, sz);
+	*csz = n + 4;
+	++c->compress;
+	c->raw += sz;
+	c->packed += *csz;
+	return buf;
+}
+
+static int
+decompressed_size(const char * buf, uint32_t sz) {
+	if (sz < 5)
+		return -1;
+	uint32_t size = unpack_uint32((const uint8_t *)buf);
+	// lz4 can't expand more than 255 times
+	if (size > LZ4BLOCK_MAX_INPUT_SIZE || size / 255 > sz)
+		return -1;
+	return (int)size;
+}
+
+static int
+decompress_payload(struct compressor *c, const char * buf, uint32_t sz, char * out, int size) {
+	uint64_t start = c ? now_ns() : 0;
+	int n = lz4block_decompress(buf + 4, out, (int)sz - 4, size);
+	if (n != size)
+		return -1;
+	if (c) {
+		c->time += now_ns() - start;
+		++c->decompress;
+		c->decompress_raw += size;
+		c->decompress_packed += sz;
+	}
+	return 0;
+}
+
+// returns a new buffer of the decompressed payload, or NULL if it's invalid
+static char *
+decompress_buffer(struct compressor *c, const char * buf, uint32_t sz, int *osz) {
+	int size = decompressed_size(buf, sz);
+	if (size < 0)
+		return NULL;
+	char * out = skynet_malloc(size > 0 ? size : 1);
+	if (decompress_payload(c, buf, sz, out, size)) {
+		skynet_free(out);
+		return NULL;
+	}
+	*osz = size;
+	return out;
+}
+
+/*
+	integer threshold
+	return compressor
+ */
+static int
+lcompressor(lua_State *L) {
+	lua_Integer threshold = luaL_optinteger(L, 1, 0);
+	struct compressor * c = lua_newuserdatauv(L, sizeof(*c), 0);
+	memset(c, 0, sizeof(*c));
+	c->threshold = threshold > 0 ? (uint32_t)threshold : 0;
+	luaL_setmetatable(L, "CLUSTER_COMPRESSOR");
+	return 1;
+}
+
+static int
+lcompressor_threshold(lua_State *L) {
+	struct compressor * c = luaL_checkudata(L, 1, "CLUSTER_COMPRESSOR");
+	if (!lua_isnoneornil(L, 2)) {
+		lua_Integer threshold = luaL_checkinteger(L, 2);
+		c->threshold = threshold > 0 ? (uint32_t)threshold : 0;
+	}
+	lua_pushinteger(L, c->threshold);
+	return 1;
+}
+
+static int
+lcompressor_stat(lua_State *L) {
+	struct compressor * c = luaL_checkudata(L, 1, "CLUSTER_COMPRESSOR");
+	lua_createtable(L, 0, 9);
+	lua_pushinteger(L, c->threshold);
+	lua_setfield(L, -2, "threshold");
+	lua_pushinteger(L, c->compress);
+	lua_setfield(L, -2, "compress");
+	lua_pushinteger(L, c->skip);
+	lua_setfield(L, -2, "skip");
+	lua_pushinteger(L, c->raw);
+	lua_setfield(L, -2, "raw");
+	lua_pushinteger(L, c->packed);
+	lua_setfield(L, -2, "packed");
+	lua_pushinteger(L, c->decompress);
+	lua_setfield(L, -2, "decompress");
+	lua_pushinteger(L, c->decompress_raw);
+	lua_setfield(L, -2, "decompress_raw");
+	lua_pushinteger(L, c->decompress_packed);
+	lua_setfield(L, -2, "decompress_packed");
+	lua_pushnumber(L, (double)c->time / 1e9);
+	lua_setfield(L, -2, "time");
+	return 1;
+}
+
 /*
 	The request package : 
 		first WORD is size of the package with big-endian
@@ -79,34 +252,46 @@ fill_header(lua_State *L, uint8_t *buf, int sz) {
 		WORD stringsz + 1
 		BYTE 4
 		STRING tag
+
+	batch
+		WORD sz + 1
+		BYTE 5
+		PADDING packages(sz)	; small requests/pushes/traces above, each with its own WORD header
+
+	option
+		WORD stringsz + 1
+		BYTE 6
+		STRING option	; "lz4 threshold" : compress the responses larger than threshold
+
+	The type of request/push (0/1/0x41/0x80/0x81/0xc1) is ORed with COMPRESSED (0x20) when msg is compressed,
+	sz is the compressed size then.
  */
 static int
-packreq_number(lua_State *L, int session, void * msg, uint32_t sz, int is_push) {
+packreq_number(lua_State *L, int session, void * msg, uint32_t sz, int is_push, int flag) {
 	uint32_t addr = (uint32_t)lua_tointeger(L,1);
-	uint8_t buf[TEMP_LENGTH];
+	uint8_t *buf;
 	if (sz < MULTI_PART) {
+		buf = new_package(L, sz+11);
 		fill_header(L, buf, sz+9);
-		buf[2] = 0;
+		buf[2] = flag;
 		fill_uint32(buf+3, addr);
 		fill_uint32(buf+7, is_push ? 0 : (uint32_t)session);
 		memcpy(buf+11,msg,sz);
-
-		lua_pushlstring(L, (const char *)buf, sz+11);
 		return 0;
 	} else {
 		int part = (sz - 1) / MULTI_PART + 1;
+		buf = new_package(L, 15);
 		fill_header(L, buf, 13);
-		buf[2] = is_push ? 0x41 : 1;	// multi push or request
+		buf[2] = (is_push ? 0x41 : 1) | flag;	// multi push or request
 		fill_uint32(buf+3, addr);
 		fill_uint32(buf+7, (uint32_t)session);
 		fill_uint32(buf+11, sz);
-		lua_pushlstring(L, (const char *)buf, 15);
 		return part;
 	}
 }
 
 static int
-packreq_string(lua_State *L, int session, void * msg, uint32_t sz, int is_push) {
+packreq_string(lua_State *L, int session, void * msg, uint32_t sz, int is_push, int flag) {
 	size_t namelen = 0;
 	const char *name = lua_tolstring(L, 1, &namelen);
 	if (name == NULL || namelen < 1 || namelen > 255) {
@@ -118,50 +303,41 @@ packreq_string(lua_State *L, int session, void * msg, uint32_t sz, int is_push)
 		}
 	}
 
-	uint8_t buf[TEMP_LENGTH];
+	uint8_t *buf;
 	if (sz < MULTI_PART) {
+		buf = new_package(L, sz+8+namelen);
 		fill_header(L, buf, sz+6+namelen);
-		buf[2] = 0x80;
+		buf[2] = 0x80 | flag;
 		buf[3] = (uint8_t)namelen;
 		memcpy(buf+4, name, namelen);
 		fill_uint32(buf+4+namelen, is_push ? 0 : (uint32_t)session);
 		memcpy(buf+8+namelen,msg,sz);
-
-		lua_pushlstring(L, (const char *)buf, sz+8+namelen);
 		return 0;
 	} else {
 		int part = (sz - 1) / MULTI_PART + 1;
+		buf = new_package(L, 12+namelen);
 		fill_header(L, buf, 10+namelen);
-		buf[2] = is_push ? 0xc1 : 0x81;	// multi push or request
+		buf[2] = (is_push ? 0xc1 : 0x81) | flag;	// multi push or request
 		buf[3] = (uint8_t)namelen;
 		memcpy(buf+4, name, namelen);
 		fill_uint32(buf+4+namelen, (uint32_t)session);
 		fill_uint32(buf+8+namelen, sz);
-
-		lua_pushlstring(L, (const char *)buf, 12+namelen);
 		return part;
 	}
 }
 
 static void
 packreq_multi(lua_State *L, int session, void * msg, uint32_t sz) {
-	uint8_t buf[TEMP_LENGTH];
 	int part = (sz - 1) / MULTI_PART + 1;
 	int i;
 	char *ptr = msg;
 	for (i=0;i<part;i++) {
-		uint32_t s;
-		if (sz > MULTI_PART) {
-			s = MULTI_PART;
-			buf[2] = 2;
-		} else {
-			s = sz;
-			buf[2] = 3;	// the last multi part
-		}
+		uint32_t s = sz > MULTI_PART ? MULTI_PART : sz;
+		uint8_t *buf = new_package(L, s+7);
+		buf[2] = sz > MULTI_PART ? 2 : 3;	// 3 : the last multi part
 		fill_header(L, buf, s+5);
 		fill_uint32(buf+3, (uint32_t)session);
 		memcpy(buf+7, ptr, s);
-		lua_pushlstring(L, (const char *)buf, s+7);
 		lua_rawseti(L, -2, i+1);
 		sz -= s;
 		ptr += s;
@@ -180,12 +356,21 @@ packrequest(lua_State *L, int is_push) {
 		skynet_free(msg);
 		return luaL_error(L, "Invalid request session %d", session);
 	}
+	int flag = 0;
+	uint32_t csz;
+	char * cmsg = compress_payload(get_compressor(L, 5), msg, sz, &csz);
+	if (cmsg) {
+		skynet_free(msg);
+		msg = cmsg;
+		sz = csz;
+		flag = COMPRESSED;
+	}
 	int addr_type = lua_type(L,1);
 	int multipak;
 	if (addr_type == LUA_TNUMBER) {
-		multipak = packreq_number(L, session, msg, sz, is_push);
+		multipak = packreq_number(L, session, msg, sz, is_push, flag);
 	} else {
-		multipak = packreq_string(L, session, msg, sz, is_push);
+		multipak = packreq_string(L, session, msg, sz, is_push, flag);
 	}
 	uint32_t new_session = (uint32_t)session + 1;
 	if (new_session > INT32_MAX) {
@@ -220,11 +405,60 @@ lpacktrace(lua_State *L) {
 	if (sz > 0x8000) {
 		return luaL_error(L, "trace tag is too long : %d", (int) sz);
 	}
-	uint8_t buf[TEMP_LENGTH];
+	uint8_t *buf = new_package(L, sz+3);
 	buf[2] = 4;
 	fill_header(L, buf, sz+1);
 	memcpy(buf+3, tag, sz);
-	lua_pushlstring(L, (const char *)buf, sz+3);
+	return 1;
+}
+
+static int
+lpackoption(lua_State *L) {
+	size_t sz;
+	const char * option = luaL_checklstring(L, 1, &sz);
+	if (sz > 0x8000) {
+		return luaL_error(L, "option is too long : %d", (int) sz);
+	}
+	uint8_t *buf = new_package(L, sz+3);
+	buf[2] = 6;
+	fill_header(L, buf, sz+1);
+	memcpy(buf+3, option, sz);
+	return 1;
+}
+
+/*
+	table of packages
+	return package batch
+ */
+static int
+lpackbatch(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int n = lua_rawlen(L, 1);
+	size_t sz = 0;
+	int i;
+	for (i=1;i<=n;i++) {
+		lua_rawgeti(L, 1, i);
+		size_t s = lua_rawlen(L, -1);
+		if (!lua_isuserdata(L, -1) || s < 3) {
+			return luaL_error(L, "Invalid package %d in batch", i);
+		}
+		sz += s;
+		lua_pop(L, 1);
+	}
+	if (sz + 1 >= 0x10000) {
+		return luaL_error(L, "Batch is too large : %d", (int)sz);
+	}
+	uint8_t * buf = new_package(L, sz + 3);
+	fill_header(L, buf, sz + 1);
+	buf[2] = 5;
+	size_t offset = 3;
+	for (i=1;i<=n;i++) {
+		lua_rawgeti(L, 1, i);
+		size_t s = lua_rawlen(L, -1);
+		memcpy(buf + offset, lua_touserdata(L, -1), s);
+		offset += s;
+		lua_pop(L, 1);
+	}
 	return 1;
 }
 
@@ -239,21 +473,34 @@ lpacktrace(lua_State *L) {
 		boolean is_push
  */
 
-static inline uint32_t
-unpack_uint32(const uint8_t * buf) {
-	return buf[0] | buf[1]<<8 | buf[2]<<16 | buf[3]<<24;
-}
-
+// own is the message buffer which can be reused for the payload, or NULL
 static void
-return_buffer(lua_State *L, const char * buffer, int sz) {
-	void * ptr = skynet_malloc(sz);
-	memcpy(ptr, buffer, sz);
+return_buffer(lua_State *L, const char * buffer, int sz, void * own, struct compressor *c, int compressed) {
+	void * ptr;
+	if (compressed) {
+		int osz;
+		ptr = decompress_buffer(c, buffer, sz, &osz);
+		if (ptr == NULL) {
+			// own is freed by lunpackrequest
+			luaL_error(L, "Invalid compressed cluster message");
+		}
+		if (own) {
+			skynet_free(own);
+		}
+		sz = osz;
+	} else if (own) {
+		ptr = own;
+		memmove(ptr, buffer, sz);
+	} else {
+		ptr = skynet_malloc(sz);
+		memcpy(ptr, buffer, sz);
+	}
 	lua_pushlightuserdata(L, ptr);
 	lua_pushinteger(L, sz);
 }
 
 static int
-unpackreq_number(lua_State *L, const uint8_t * buf, int sz) {
+unpackreq_number(lua_State *L, const uint8_t * buf, int sz, void * own, struct compressor *c) {
 	if (sz < 9) {
 		return luaL_error(L, "Invalid cluster message (size=%d)", sz);
 	}
@@ -262,7 +509,7 @@ unpackreq_number(lua_State *L, const uint8_t * buf, int sz) {
 	lua_pushinteger(L, address);
 	lua_pushinteger(L, session);
 
-	return_buffer(L, (const char *)buf+9, sz-9);
+	return_buffer(L, (const char *)buf+9, sz-9, own, c, buf[0] & COMPRESSED);
 	if (session == 0) {
 		lua_pushnil(L);
 		lua_pushboolean(L,1);	// is_push, no reponse
@@ -283,7 +530,8 @@ unpackmreq_number(lua_State *L, const uint8_t * buf, int sz, int is_push) {
 	lua_pushinteger(L, address);
 	lua_pushinteger(L, session);
 	lua_pushnil(L);
-	lua_pushinteger(L, size);
+	// negative size : the parts are compressed, see lconcat
+	lua_pushinteger(L, (buf[0] & COMPRESSED) ? -(lua_Integer)size : size);
 	lua_pushboolean(L, 1);	// padding multi part
 	lua_pushboolean(L, is_push);
 
@@ -291,7 +539,7 @@ unpackmreq_number(lua_State *L, const uint8_t * buf, int sz, int is_push) {
 }
 
 static int
-unpackmreq_part(lua_State *L, const uint8_t * buf, int sz) {
+unpackmreq_part(lua_State *L, const uint8_t * buf, int sz, void * own) {
 	if (sz < 5) {
 		return luaL_error(L, "Invalid cluster multi part message");
 	}
@@ -299,7 +547,7 @@ unpackmreq_part(lua_State *L, const uint8_t * buf, int sz) {
 	uint32_t session = unpack_uint32(buf+1);
 	lua_pushboolean(L, 0);	// no address
 	lua_pushinteger(L, session);
-	return_buffer(L, (const char *)buf+5, sz-5);
+	return_buffer(L, (const char *)buf+5, sz-5, own, NULL, 0);
 	lua_pushboolean(L, padding);
 
 	return 5;
@@ -312,7 +560,7 @@ unpacktrace(lua_State *L, const char * buf, int sz) {
 }
 
 static int
-unpackreq_string(lua_State *L, const uint8_t * buf, int sz) {
+unpackreq_string(lua_State *L, const uint8_t * buf, int sz, void * own, struct compressor *c) {
 	if (sz < 2) {
 		return luaL_error(L, "Invalid cluster message (size=%d)", sz);
 	}
@@ -323,7 +571,7 @@ unpackreq_string(lua_State *L, const uint8_t * buf, int sz) {
 	lua_pushlstring(L, (const char *)buf+2, namesz);
 	uint32_t session = unpack_uint32(buf + namesz + 2);
 	lua_pushinteger(L, (uint32_t)session);
-	return_buffer(L, (const char *)buf+2+namesz+4, sz - namesz - 6);
+	return_buffer(L, (const char *)buf+2+namesz+4, sz - namesz - 6, own, c, buf[0] & COMPRESSED);
 	if (session == 0) {
 		lua_pushnil(L);
 		lua_pushboolean(L,1);	// is_push, no reponse
@@ -347,7 +595,7 @@ unpackmreq_string(lua_State *L, const uint8_t * buf, int sz, int is_push) {
 	uint32_t size = unpack_uint32(buf + namesz + 6);
 	lua_pushinteger(L, session);
 	lua_pushnil(L);
-	lua_pushinteger(L, size);
+	lua_pushinteger(L, (buf[0] & COMPRESSED) ? -(lua_Integer)size : size);
 	lua_pushboolean(L, 1);	// padding multipart
 	lua_pushboolean(L, is_push);
 
@@ -355,42 +603,195 @@ unpackmreq_string(lua_State *L, const uint8_t * buf, int sz, int is_push) {
 }
 
 static int
-lunpackrequest(lua_State *L) {
-	int sz;
-	const char *msg;
-	if (lua_type(L, 1) == LUA_TLIGHTUSERDATA) {
-		msg = (const char *)lua_touserdata(L, 1);
-		sz = luaL_checkinteger(L, 2);
-	} else {
-		size_t ssz;
-		msg = luaL_checklstring(L,1,&ssz);
-		sz = (int)ssz;
-	}
+unpackoption(lua_State *L, const char * buf, int sz) {
+	lua_pushnil(L);	// no address
+	lua_pushlstring(L, buf + 1, sz - 1);
+	return 2;
+}
+
+static int unpackbatch(lua_State *L, const uint8_t * buf, int sz, void * own, struct compressor *c);
+
+static int
+unpackreq(lua_State *L, const char * msg, int sz, void * own, struct compressor *c) {
 	if (sz == 0)
 		return luaL_error(L, "Invalid req package. size == 0");
 	switch (msg[0]) {
 	case 0:
-		return unpackreq_number(L, (const uint8_t *)msg, sz);
+	case '\x20':
+		return unpackreq_number(L, (const uint8_t *)msg, sz, own, c);
 	case 1:
+	case '\x21':
 		return unpackmreq_number(L, (const uint8_t *)msg, sz, 0);	// request
 	case '\x41':
+	case '\x61':
 		return unpackmreq_number(L, (const uint8_t *)msg, sz, 1);	// push
 	case 2:
 	case 3:
-		return unpackmreq_part(L, (const uint8_t *)msg, sz);
+		return unpackmreq_part(L, (const uint8_t *)msg, sz, own);
 	case 4:
 		return unpacktrace(L, msg, sz);
 	case '\x80':
-		return unpackreq_string(L, (const uint8_t *)msg, sz);
+	case '\xa0':
+		return unpackreq_string(L, (const uint8_t *)msg, sz, own, c);
 	case '\x81':
+	case '\xa1':
 		return unpackmreq_string(L, (const uint8_t *)msg, sz, 0 );	// request
 	case '\xc1':
+	case '\xe1':
 		return unpackmreq_string(L, (const uint8_t *)msg, sz, 1 );	// push
+	case 5:
+		return unpackbatch(L, (const uint8_t *)msg, sz, own, c);
+	case 6:
+		return unpackoption(L, msg, sz);
 	default:
 		return luaL_error(L, "Invalid req package type %d", msg[0]);
 	}
 }
 
+// unpack one package of the batch in pcall, returns a table.pack of the values
+static int
+lunpackbatch_item(lua_State *L) {
+	const char * buf = (const char *)lua_touserdata(L, 1);
+	int sz = (int)lua_tointeger(L, 2);
+	struct compressor *c = (struct compressor *)lua_touserdata(L, 3);
+	lua_settop(L, 0);
+	int r = unpackreq(L, buf, sz, NULL, c);
+	lua_createtable(L, r, 1);
+	lua_insert(L, 1);
+	int j;
+	for (j=r;j>=1;j--) {
+		lua_rawseti(L, 1, j);
+	}
+	lua_pushinteger(L, r);
+	lua_setfield(L, 1, "n");
+	return 1;
+}
+
+// free the payloads of the packages unpacked before an error
+static void
+free_batch(lua_State *L, int index, int n) {
+	int i;
+	for (i=1;i<=n;i++) {
+		lua_rawgeti(L, index, i);
+		lua_getfield(L, -1, "n");
+		int r = (int)lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		int j;
+		for (j=1;j<=r;j++) {
+			if (lua_rawgeti(L, -1, j) == LUA_TLIGHTUSERDATA) {
+				skynet_free(lua_touserdata(L, -1));
+			}
+			lua_pop(L, 1);
+		}
+		lua_pop(L, 1);
+	}
+}
+
+/*
+	return a table of packages, each one is a table.pack of the values unpackrequest returns
+	own is freed when it succeeds, and the payloads are freed if a package is invalid
+ */
+static int
+unpackbatch(lua_State *L, const uint8_t * buf, int sz, void * own, struct compressor *c) {
+	// check the frames first, so that no message is allocated before an error
+	int offset = 1;
+	int n = 0;
+	while (offset < sz) {
+		int len = offset + 2 > sz ? 0 : (buf[offset] << 8 | buf[offset+1]);
+		offset += 2;
+		if (len == 0 || offset + len > sz || buf[offset] == 5) {
+			return luaL_error(L, "Invalid cluster batch (size=%d)", sz);
+		}
+		offset += len;
+		++n;
+	}
+	lua_createtable(L, n, 0);
+	int batch = lua_gettop(L);
+	offset = 1;
+	int i;
+	for (i=1;i<=n;i++) {
+		int len = buf[offset] << 8 | buf[offset+1];
+		offset += 2;
+		lua_pushcfunction(L, lunpackbatch_item);
+		lua_pushlightuserdata(L, (void *)(buf + offset));
+		lua_pushinteger(L, len);
+		lua_pushlightuserdata(L, c);
+		if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
+			free_batch(L, batch, i - 1);
+			return lua_error(L);
+		}
+		lua_rawseti(L, batch, i);
+		offset += len;
+	}
+	skynet_free(own);
+	return 1;
+}
+
+// unpackreq in pcall, so that lunpackrequest can free own when the package is invalid
+static int
+lunpackreq_own(lua_State *L) {
+	const char * msg = (const char *)lua_touserdata(L, 1);
+	int sz = (int)lua_tointeger(L, 2);
+	void * own = lua_touserdata(L, 3);
+	struct compressor *c = (struct compressor *)lua_touserdata(L, 4);
+	lua_settop(L, 0);
+	return unpackreq(L, msg, sz, own, c);
+}
+
+/*
+	lightuserdata msg / string msg
+	integer sz
+	boolean own : msg is owned by unpackrequest, the payload is moved to the head of msg instead of copied.
+		msg is freed if the package has no payload, the payload is compressed, or the package is invalid.
+	compressor : optional, counts the decompressed payloads
+ */
+static int
+lunpackrequest(lua_State *L) {
+	int sz;
+	const char *msg;
+	struct compressor *c = get_compressor(L, 4);
+	if (lua_type(L, 1) == LUA_TLIGHTUSERDATA) {
+		msg = (const char *)lua_touserdata(L, 1);
+		sz = luaL_checkinteger(L, 2);
+		if (lua_toboolean(L, 3)) {
+			void * own = (void *)msg;
+			int type = sz > 0 ? (uint8_t)msg[0] : -1;
+			int reuse = 0;
+			switch (type) {
+			case 0:
+			case 2:
+			case 3:
+			case 0x20:
+			case 0x80:
+			case 0xa0:
+			case 5:
+				reuse = 1;
+				break;
+			}
+			int top = lua_gettop(L);
+			lua_pushcfunction(L, lunpackreq_own);
+			lua_pushlightuserdata(L, own);
+			lua_pushinteger(L, sz);
+			lua_pushlightuserdata(L, reuse ? own : NULL);
+			lua_pushlightuserdata(L, c);
+			if (lua_pcall(L, 4, LUA_MULTRET, 0) != LUA_OK) {
+				// no payload has taken own before the error
+				skynet_free(own);
+				return lua_error(L);
+			}
+			if (!reuse) {
+				skynet_free(own);
+			}
+			return lua_gettop(L) - top;
+		}
+	} else {
+		size_t ssz;
+		msg = luaL_checklstring(L,1,&ssz);
+		sz = (int)ssz;
+	}
+	return unpackreq(L, msg, sz, NULL, c);
+}
+
 /*
 	The response package :
 	WORD size (big endian)
@@ -401,17 +802,53 @@ lunpackrequest(lua_State *L) {
 		2: multi begin
 		3: multi part
 		4: multi end
+		5: ok, compressed
+		6: multi begin, compressed
 	PADDING msg
 		type = 0, error msg
 		type = 1, msg
-		type = 2, DWORD size
+		type = 2/6, DWORD size
 		type = 3/4, msg
+		type = 5, compressed msg
  */
+static void
+pack_response(lua_State *L, uint32_t session, int type, const void * msg, size_t sz) {
+	uint8_t * buf = new_package(L, sz+7);
+	fill_header(L, buf, sz+5);
+	fill_uint32(buf+2, session);
+	buf[6] = type;
+	memcpy(buf+7,msg,sz);
+}
+
+static void
+pack_multiresponse(lua_State *L, uint32_t session, int type, const char * msg, size_t sz) {
+	int part = (sz - 1) / MULTI_PART + 1;
+	lua_createtable(L, part+1, 0);
+
+	// multi part begin
+	uint8_t * buf = new_package(L, 11);
+	fill_header(L, buf, 9);
+	fill_uint32(buf+2, session);
+	buf[6] = type;
+	fill_uint32(buf+7, (uint32_t)sz);
+	lua_rawseti(L, -2, 1);
+
+	int i;
+	for (i=0;i<part;i++) {
+		int s = sz > MULTI_PART ? MULTI_PART : sz;
+		pack_response(L, session, sz > MULTI_PART ? 3 : 4, msg, s);
+		lua_rawseti(L, -2, i+2);
+		sz -= s;
+		msg += s;
+	}
+}
+
 /*
 	int session
 	boolean ok
 	lightuserdata msg
 	int sz
+	compressor : optional
 	return string response
  */
 static int
@@ -436,61 +873,61 @@ lpackresponse(lua_State *L) {
 			sz = MULTI_PART;
 		}
 	} else {
-		if (sz > MULTI_PART) {
-			// return 
-			int part = (sz - 1) / MULTI_PART + 1;
-			lua_createtable(L, part+1, 0);
-			uint8_t buf[TEMP_LENGTH];
-
-			// multi part begin
-			fill_header(L, buf, 9);
-			fill_uint32(buf+2, session);
-			buf[6] = 2;
-			fill_uint32(buf+7, (uint32_t)sz);
-			lua_pushlstring(L, (const char *)buf, 11);
-			lua_rawseti(L, -2, 1);
-
-			char * ptr = msg;
-			int i;
-			for (i=0;i<part;i++) {
-				int s;
-				if (sz > MULTI_PART) {
-					s = MULTI_PART;
-					buf[6] = 3;
-				} else {
-					s = sz;
-					buf[6] = 4;
-				}
-				fill_header(L, buf, s+5);
-				fill_uint32(buf+2, session);
-				memcpy(buf+7,ptr,s);
-				lua_pushlstring(L, (const char *)buf, s+7);
-				lua_rawseti(L, -2, i+2);
-				sz -= s;
-				ptr += s;
+		uint32_t csz;
+		char * cmsg = compress_payload(get_compressor(L, 5), msg, sz, &csz);
+		if (cmsg) {
+			if (csz > MULTI_PART) {
+				pack_multiresponse(L, session, 6, cmsg, csz);
+			} else {
+				pack_response(L, session, 5, cmsg, csz);
 			}
+			skynet_free(cmsg);
+			return 1;
+		}
+		if (sz > MULTI_PART) {
+			pack_multiresponse(L, session, 2, msg, sz);
 			return 1;
 		}
 	}
 
-	uint8_t buf[TEMP_LENGTH];
-	fill_header(L, buf, sz+5);
-	fill_uint32(buf+2, session);
-	buf[6] = ok;
-	memcpy(buf+7,msg,sz);
-
-	lua_pushlstring(L, (const char *)buf, sz+7);
+	pack_response(L, session, ok, msg, sz);
 
 	return 1;
 }
 
 /*
 	string packed response
+		or string header (5 bytes) , string payload : the payload is returned without copy
+	compressor : optional
 	return integer session
 		boolean ok
 		string msg
 		boolean padding
  */
+static void
+push_payload(lua_State *L, const char * buf, size_t sz) {
+	if (lua_isstring(L, 2)) {
+		lua_pushvalue(L, 2);
+	} else {
+		lua_pushlstring(L, buf+5, sz-5);
+	}
+}
+
+static int
+unpack_compressed(lua_State *L, const char * buf, size_t sz) {
+	const char * payload = lua_isstring(L, 2) ? lua_tostring(L, 2) : buf + 5;
+	sz -= 5;
+	int size = decompressed_size(payload, sz);
+	if (size < 0)
+		return 0;
+	luaL_Buffer b;
+	char * out = luaL_buffinitsize(L, &b, size);
+	if (decompress_payload(get_compressor(L, 3), payload, sz, out, size))
+		return 0;
+	luaL_pushresultsize(&b, size);
+	return 1;
+}
+
 static int
 lunpackresponse(lua_State *L) {
 	size_t sz;
@@ -498,30 +935,46 @@ lunpackresponse(lua_State *L) {
 	if (sz < 5) {
 		return 0;
 	}
+	if (lua_isstring(L, 2)) {
+		if (sz != 5) {
+			return 0;
+		}
+		sz += lua_rawlen(L, 2);
+	}
 	uint32_t session = unpack_uint32((const uint8_t *)buf);
 	lua_pushinteger(L, (lua_Integer)session);
 	switch(buf[4]) {
 	case 0:	// error
 		lua_pushboolean(L, 0);
-		lua_pushlstring(L, buf+5, sz-5);
+		push_payload(L, buf, sz);
 		return 3;
 	case 1:	// ok
 	case 4:	// multi end
 		lua_pushboolean(L, 1);
-		lua_pushlstring(L, buf+5, sz-5);
+		push_payload(L, buf, sz);
 		return 3;
 	case 2:	// multi begin
+	case 6:	// multi begin, compressed
 		if (sz != 9) {
 			return 0;
 		}
-		sz = unpack_uint32((const uint8_t *)buf+5);
+		push_payload(L, buf, sz);
+		sz = unpack_uint32((const uint8_t *)lua_tostring(L, -1));
+		lua_pop(L, 1);
 		lua_pushboolean(L, 1);
-		lua_pushinteger(L, sz);
+		// negative size : the parts are compressed, see lconcat
+		lua_pushinteger(L, buf[4] == 6 ? -(lua_Integer)sz : (lua_Integer)sz);
 		lua_pushboolean(L, 1);
 		return 4;
+	case 5:	// ok, compressed
+		lua_pushboolean(L, 1);
+		if (!unpack_compressed(L, buf, sz)) {
+			return 0;
+		}
+		return 3;
 	case 3:	// multi part
 		lua_pushboolean(L, 1);
-		lua_pushlstring(L, buf+5, sz-5);
+		push_payload(L, buf, sz);
 		lua_pushboolean(L, 1);
 		return 4;
 	default:
@@ -555,14 +1008,21 @@ lappend(lua_State *L) {
 	return 0;
 }
 
+/*
+	table : size, parts ...	; the parts are compressed if size is negative
+	compressor : optional
+	return lightuserdata, sz
+ */
 static int
 lconcat(lua_State *L) {
 	if (!lua_istable(L,1))
 		return 0;
 	if (lua_geti(L,1,1) != LUA_TNUMBER)
 		return 0;
-	int sz = lua_tointeger(L,-1);
+	lua_Integer size = lua_tointeger(L,-1);
 	lua_pop(L,1);
+	int compressed = size < 0;
+	int sz = (int)(compressed ? -size : size);
 	char * buff = skynet_malloc(sz);
 	int idx = 2;
 	int offset = 0;
@@ -582,6 +1042,13 @@ lconcat(lua_State *L) {
 		skynet_free(buff);
 		return 0;
 	}
+	if (compressed) {
+		char * out = decompress_buffer(get_compressor(L, 2), buff, sz, &sz);
+		skynet_free(buff);
+		if (out == NULL)
+			return 0;
+		buff = out;
+	}
 	// buff/sz will send to other service, See clusterd.lua
 	lua_pushlightuserdata(L, buff);
 	lua_pushinteger(L, sz);
@@ -621,6 +1088,8 @@ luaopen_skynet_cluster_core(lua_State *L) {
 		{ "packrequest", lpackrequest },
 		{ "packpush", lpackpush },
 		{ "packtrace", lpacktrace },
+		{ "packbatch", lpackbatch },
+		{ "packoption", lpackoption },
 		{ "unpackrequest", lunpackrequest },
 		{ "packresponse", lpackresponse },
 		{ "unpackresponse", lunpackresponse },
@@ -628,9 +1097,21 @@ luaopen_skynet_cluster_core(lua_State *L) {
 		{ "concat", lconcat },
 		{ "isname", lisname },
 		{ "nodename", lnodename },
+		{ "compressor", lcompressor },
 		{ NULL, NULL },
 	};
 	luaL_checkversion(L);
+
+	luaL_Reg compressor_methods[] = {
+		{ "threshold", lcompressor_threshold },
+		{ "stat", lcompressor_stat },
+		{ NULL, NULL },
+	};
+	luaL_newmetatable(L, "CLUSTER_COMPRESSOR");
+	luaL_newlib(L, compressor_methods);
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+
 	luaL_newlib(L,l);
 
 	return 1;
@@ -1,8 +1,8 @@
 #define LUA_LIB
 
-#include "skynet_malloc.h"
-
+#include "skynet.h"
 #include "skynet_socket.h"
+#include "frame_format.h"
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -15,6 +15,7 @@
 #define QUEUESIZE 1024
 #define HASHSIZE 4096
 #define SMALLSTRING 2048
+#define MAX_PACKAGE 0x1000000
 
 #define TYPE_DATA 1
 #define TYPE_MORE 2
@@ -23,29 +24,44 @@
 #define TYPE_CLOSE 5
 #define TYPE_WARNING 6
 #define TYPE_INIT 7
+#define TYPE_DRAIN 8
 
 /*
 	Each package is uint16 + data , uint16 (serialized in big-endian) is the number of bytes comprising the data .
+	The header can be changed by netpack.format, See skynet-src/frame_format.h
  */
 
 struct netpack {
 	int id;
 	int size;
 	void * buffer;
+	uint32_t msgid;	// the id field of header
 };
 
 struct uncomplete {
 	struct netpack pack;
 	struct uncomplete * next;
-	int read;
-	int header;
+	int read;	// -1 : reading the length field
+	int header_size;
+	uint8_t header[FRAME_LENGTH_MAX];
+};
+
+// complete packages of a routed fd are sent to handle directly, don't enter lua
+struct route {
+	int id;
+	uint32_t handle;
+	uint32_t source;
+	struct route * next;
 };
 
 struct queue {
 	int cap;
 	int head;
 	int tail;
+	struct skynet_context * ctx;
+	struct frame_format format;
 	struct uncomplete * hash[HASHSIZE];
+	struct route * route[HASHSIZE];
 	struct netpack queue[QUEUESIZE];
 };
 
@@ -59,6 +75,15 @@ clear_list(struct uncomplete * uc) {
 	}
 }
 
+static void
+clear_route(struct route * r) {
+	while (r) {
+		struct route * tmp = r;
+		r = r->next;
+		skynet_free(tmp);
+	}
+}
+
 static int
 lclear(lua_State *L) {
 	struct queue * q = lua_touserdata(L, 1);
@@ -69,6 +94,8 @@ lclear(lua_State *L) {
 	for (i=0;i<HASHSIZE;i++) {
 		clear_list(q->hash[i]);
 		q->hash[i] = NULL;
+		clear_route(q->route[i]);
+		q->route[i] = NULL;
 	}
 	if (q->head > q->tail) {
 		q->tail += q->cap;
@@ -114,6 +141,72 @@ find_uncomplete(struct queue *q, int fd) {
 	return NULL;
 }
 
+static inline struct route *
+find_route(struct queue *q, int fd) {
+	if (q == NULL)
+		return NULL;
+	struct route * r = q->route[hash_fd(fd)];
+	while (r) {
+		if (r->id == fd)
+			return r;
+		r = r->next;
+	}
+	return NULL;
+}
+
+static void
+remove_route(struct queue *q, int fd) {
+	if (q == NULL)
+		return;
+	struct route ** pr = &q->route[hash_fd(fd)];
+	while (*pr) {
+		struct route * r = *pr;
+		if (r->id == fd) {
+			*pr = r->next;
+			skynet_free(r);
+			return;
+		}
+		pr = &r->next;
+	}
+}
+
+static inline void
+send_route(struct queue *q, struct route *r, void *buffer, int size) {
+	// the session is fd, the same as gate.lua redirect
+	skynet_send(q->ctx, r->source, r->handle, PTYPE_CLIENT | PTYPE_TAG_DONTCOPY, r->id, buffer, size);
+}
+
+/*
+	Send the queued packages of the routed fd to the route target (with the id field, the same as push_data),
+	so the packages of fd queued before the route is set are neither reordered nor popped by lua.
+ */
+static void
+flush_route(struct queue *q, struct route *r) {
+	int idsz = frame_id_size(&q->format);
+	int i = q->head;
+	int tail = q->head;
+	while (i != q->tail) {
+		struct netpack *np = &q->queue[i];
+		if (np->id == r->id) {
+			void * buffer = np->buffer;
+			if (idsz > 0) {
+				buffer = skynet_malloc(np->size + idsz);
+				frame_write_fixed(&q->format.id, buffer, np->msgid);
+				memcpy((uint8_t *)buffer + idsz, np->buffer, np->size);
+				skynet_free(np->buffer);
+			}
+			send_route(q, r, buffer, np->size + idsz);
+		} else {
+			q->queue[tail] = *np;
+			if (++tail >= q->cap)
+				tail = 0;
+		}
+		if (++i >= q->cap)
+			i = 0;
+	}
+	q->tail = tail;
+}
+
 static struct queue *
 get_queue(lua_State *L) {
 	struct queue *q = lua_touserdata(L,1);
@@ -122,9 +215,12 @@ get_queue(lua_State *L) {
 		q->cap = QUEUESIZE;
 		q->head = 0;
 		q->tail = 0;
+		q->ctx = NULL;
+		frame_format_default(&q->format);
 		int i;
 		for (i=0;i<HASHSIZE;i++) {
 			q->hash[i] = NULL;
+			q->route[i] = NULL;
 		}
 		lua_replace(L, 1);
 	}
@@ -137,8 +233,12 @@ expand_queue(lua_State *L, struct queue *q) {
 	nq->cap = q->cap + QUEUESIZE;
 	nq->head = 0;
 	nq->tail = q->cap;
+	nq->ctx = q->ctx;
+	nq->format = q->format;
 	memcpy(nq->hash, q->hash, sizeof(nq->hash));
 	memset(q->hash, 0, sizeof(q->hash));
+	memcpy(nq->route, q->route, sizeof(nq->route));
+	memset(q->route, 0, sizeof(q->route));
 	int i;
 	for (i=0;i<q->cap;i++) {
 		int idx = (q->head + i) % q->cap;
@@ -148,25 +248,76 @@ expand_queue(lua_State *L, struct queue *q) {
 	lua_replace(L,1);
 }
 
+/*
+	body is the frame after the length field : [id field] payload
+	The body (with the id field) of a routed fd is sent to the route target,
+	otherwise the payload is queued with the id.
+	When clone is 0, body is owned by netpack (the buffer of uncomplete).
+ */
 static void
-push_data(lua_State *L, int fd, void *buffer, int size, int clone) {
+push_data(lua_State *L, const struct frame_format *f, int fd, uint8_t *body, int size, int clone) {
+	struct queue *q = lua_touserdata(L,1);
+	struct route *r = find_route(q, fd);
+	if (r) {
+		if (clone) {
+			void * tmp = skynet_malloc(size);
+			memcpy(tmp, body, size);
+			body = tmp;
+		}
+		send_route(q, r, body, size);
+		return;
+	}
+	uint32_t msgid = frame_id(f, body);
+	int idsz = frame_id_size(f);
+	void * buffer = body;
+	size -= idsz;
 	if (clone) {
-		void * tmp = skynet_malloc(size);
-		memcpy(tmp, buffer, size);
-		buffer = tmp;
+		buffer = skynet_malloc(size);
+		memcpy(buffer, body + idsz, size);
+	} else if (idsz > 0) {
+		memmove(buffer, body + idsz, size);
 	}
-	struct queue *q = get_queue(L);
+	q = get_queue(L);
 	struct netpack *np = &q->queue[q->tail];
 	if (++q->tail >= q->cap)
 		q->tail -= q->cap;
 	np->id = fd;
 	np->buffer = buffer;
 	np->size = size;
+	np->msgid = msgid;
 	if (q->head == q->tail) {
 		expand_queue(L, q);
 	}
 }
 
+/*
+	buffer (malloc by socket_server or netpack) has only one package, the body is in it.
+	Reuse buffer for the package, returns the number of values pushed.
+ */
+static int
+push_one(lua_State *L, const struct frame_format *f, int fd, void *buffer, uint8_t *body, int size) {
+	struct queue *q = lua_touserdata(L,1);
+	struct route *r = find_route(q, fd);
+	if (r) {
+		memmove(buffer, body, size);
+		send_route(q, r, buffer, size);
+		return 1;
+	}
+	uint32_t msgid = frame_id(f, body);
+	int idsz = frame_id_size(f);
+	size -= idsz;
+	memmove(buffer, body + idsz, size);
+	lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
+	lua_pushinteger(L, fd);
+	lua_pushlightuserdata(L, buffer);
+	lua_pushinteger(L, size);
+	if (f->id.width == FRAME_NONE) {
+		return 5;
+	}
+	lua_pushinteger(L, msgid);
+	return 6;
+}
+
 static struct uncomplete *
 save_uncomplete(lua_State *L, int fd) {
 	struct queue *q = get_queue(L);
@@ -180,39 +331,53 @@ save_uncomplete(lua_State *L, int fd) {
 	return uc;
 }
 
-static inline int
-read_size(uint8_t * buffer) {
-	int r = (int)buffer[0] << 8 | (int)buffer[1];
-	return r;
+static inline void
+insert_uncomplete(struct queue *q, struct uncomplete *uc) {
+	int h = hash_fd(uc->pack.id);
+	uc->next = q->hash[h];
+	q->hash[h] = uc;
 }
 
-static void
-push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
-	if (size == 1) {
-		struct uncomplete * uc = save_uncomplete(L, fd);
-		uc->read = -1;
-		uc->header = *buffer;
-		return;
-	}
-	int pack_size = read_size(buffer);
-	buffer += 2;
-	size -= 2;
+// returns the size of the length field, 0 if it's incomplete, -1 if it's invalid or too large
+static inline int
+read_header(const struct frame_format *f, const uint8_t *buffer, int size, uint32_t *pack_size) {
+	int hs = frame_length(f, buffer, size, pack_size);
+	if (hs > 0 && *pack_size >= MAX_PACKAGE)
+		return -1;
+	return hs;
+}
 
-	if (size < pack_size) {
-		struct uncomplete * uc = save_uncomplete(L, fd);
-		uc->read = size;
-		uc->pack.size = pack_size;
-		uc->pack.buffer = skynet_malloc(pack_size);
-		memcpy(uc->pack.buffer, buffer, size);
-		return;
-	}
-	push_data(L, fd, buffer, pack_size, 1);
+// returns -1 if the header is invalid
+static int
+push_more(lua_State *L, const struct frame_format *f, int fd, uint8_t *buffer, int size) {
+	while (size > 0) {
+		uint32_t pack_size;
+		int hs = read_header(f, buffer, size, &pack_size);
+		if (hs < 0)
+			return -1;
+		if (hs == 0) {
+			struct uncomplete * uc = save_uncomplete(L, fd);
+			uc->read = -1;
+			uc->header_size = size;
+			memcpy(uc->header, buffer, size);
+			return 0;
+		}
+		buffer += hs;
+		size -= hs;
 
-	buffer += pack_size;
-	size -= pack_size;
-	if (size > 0) {
-		push_more(L, fd, buffer, size);
+		if (size < (int)pack_size) {
+			struct uncomplete * uc = save_uncomplete(L, fd);
+			uc->read = size;
+			uc->pack.size = pack_size;
+			uc->pack.buffer = skynet_malloc(pack_size);
+			memcpy(uc->pack.buffer, buffer, size);
+			return 0;
+		}
+		push_data(L, f, fd, buffer, pack_size, 1);
+		buffer += pack_size;
+		size -= pack_size;
 	}
+	return 0;
 }
 
 static void
@@ -223,21 +388,50 @@ close_uncomplete(lua_State *L, int fd) {
 		skynet_free(uc->pack.buffer);
 		skynet_free(uc);
 	}
+	remove_route(q, fd);
 }
 
 static int
-filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
+invalid_data(lua_State *L, int fd) {
+	lua_settop(L, 1);
+	lua_pushvalue(L, lua_upvalueindex(TYPE_ERROR));
+	lua_pushinteger(L, fd);
+	lua_pushliteral(L, "Invalid package header (or > 16M)");
+	return 4;
+}
+
+static int
+filter_data_(lua_State *L, int fd, uint8_t * buffer, int size, int *keep) {
 	struct queue *q = lua_touserdata(L,1);
+	struct frame_format f;
+	if (q) {
+		f = q->format;
+	} else {
+		frame_format_default(&f);
+	}
+	uint32_t pack_size;
 	struct uncomplete * uc = find_uncomplete(q, fd);
 	if (uc) {
 		// fill uncomplete
 		if (uc->read < 0) {
-			// read size
-			assert(uc->read == -1);
-			int pack_size = *buffer;
-			pack_size |= uc->header << 8 ;
-			++buffer;
-			--size;
+			// read the length field
+			int n = FRAME_LENGTH_MAX - uc->header_size;
+			if (n > size)
+				n = size;
+			memcpy(uc->header + uc->header_size, buffer, n);
+			int hs = read_header(&f, uc->header, uc->header_size + n, &pack_size);
+			if (hs < 0) {
+				skynet_free(uc);
+				return invalid_data(L, fd);
+			}
+			if (hs == 0) {
+				uc->header_size += n;
+				insert_uncomplete(q, uc);
+				return 1;
+			}
+			n = hs - uc->header_size;
+			buffer += n;
+			size -= n;
 			uc->pack.size = pack_size;
 			uc->pack.buffer = skynet_malloc(pack_size);
 			uc->read = 0;
@@ -246,62 +440,35 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		if (size < need) {
 			memcpy(uc->pack.buffer + uc->read, buffer, size);
 			uc->read += size;
-			int h = hash_fd(fd);
-			uc->next = q->hash[h];
-			q->hash[h] = uc;
+			insert_uncomplete(q, uc);
 			return 1;
 		}
 		memcpy(uc->pack.buffer + uc->read, buffer, need);
 		buffer += need;
 		size -= need;
+		uint8_t * body = uc->pack.buffer;
+		int body_size = uc->pack.size;
+		skynet_free(uc);
 		if (size == 0) {
-			lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
-			lua_pushinteger(L, fd);
-			lua_pushlightuserdata(L, uc->pack.buffer);
-			lua_pushinteger(L, uc->pack.size);
-			skynet_free(uc);
-			return 5;
+			return push_one(L, &f, fd, body, body, body_size);
 		}
 		// more data
-		push_data(L, fd, uc->pack.buffer, uc->pack.size, 0);
-		skynet_free(uc);
-		push_more(L, fd, buffer, size);
+		push_data(L, &f, fd, body, body_size, 0);
+		if (push_more(L, &f, fd, buffer, size)) {
+			return invalid_data(L, fd);
+		}
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	} else {
-		if (size == 1) {
-			struct uncomplete * uc = save_uncomplete(L, fd);
-			uc->read = -1;
-			uc->header = *buffer;
-			return 1;
-		}
-		int pack_size = read_size(buffer);
-		buffer+=2;
-		size-=2;
-
-		if (size < pack_size) {
-			struct uncomplete * uc = save_uncomplete(L, fd);
-			uc->read = size;
-			uc->pack.size = pack_size;
-			uc->pack.buffer = skynet_malloc(pack_size);
-			memcpy(uc->pack.buffer, buffer, size);
-			return 1;
+		int hs = read_header(&f, buffer, size, &pack_size);
+		if (hs > 0 && hs + pack_size == size) {
+			// just one package, reuse the socket buffer
+			*keep = 1;
+			return push_one(L, &f, fd, buffer, buffer + hs, pack_size);
 		}
-		if (size == pack_size) {
-			// just one package
-			lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
-			lua_pushinteger(L, fd);
-			void * result = skynet_malloc(pack_size);
-			memcpy(result, buffer, size);
-			lua_pushlightuserdata(L, result);
-			lua_pushinteger(L, size);
-			return 5;
+		if (push_more(L, &f, fd, buffer, size)) {
+			return invalid_data(L, fd);
 		}
-		// more data
-		push_data(L, fd, buffer, pack_size, 1);
-		buffer += pack_size;
-		size -= pack_size;
-		push_more(L, fd, buffer, size);
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	}
@@ -309,10 +476,21 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 
 static inline int
 filter_data(lua_State *L, int fd, uint8_t * buffer, int size) {
-	int ret = filter_data_(L, fd, buffer, size);
+	int keep = 0;
+	int ret = filter_data_(L, fd, buffer, size, &keep);
 	// buffer is the data of socket message, it malloc at socket_server.c : function forward_message .
-	// it should be free before return,
-	skynet_free(buffer);
+	// it should be free before return, unless it's reused by the package.
+	if (!keep) {
+		skynet_free(buffer);
+	}
+	if (ret == 2) {
+		struct queue *q = lua_touserdata(L,1);
+		if (q == NULL || q->head == q->tail) {
+			// the packages are routed, or incomplete
+			lua_settop(L, 1);
+			return 1;
+		}
+	}
 	return ret;
 }
 
@@ -384,6 +562,11 @@ lfilter(lua_State *L) {
 		lua_pushinteger(L, message->id);
 		lua_pushinteger(L, message->ud);
 		return 4;
+	case SKYNET_SOCKET_TYPE_DRAIN:
+		lua_pushvalue(L, lua_upvalueindex(TYPE_DRAIN));
+		lua_pushinteger(L, message->id);
+		lua_pushinteger(L, message->ud);
+		return 4;
 	default:
 		// never get here
 		return 1;
@@ -396,6 +579,7 @@ lfilter(lua_State *L) {
 		integer fd
 		lightuserdata msg
 		integer size
+		integer id (if the header has an id field)
  */
 static int
 lpop(lua_State *L) {
@@ -409,8 +593,72 @@ lpop(lua_State *L) {
 	lua_pushinteger(L, np->id);
 	lua_pushlightuserdata(L, np->buffer);
 	lua_pushinteger(L, np->size);
+	if (q->format.id.width == FRAME_NONE) {
+		return 3;
+	}
+	lua_pushinteger(L, np->msgid);
+	return 4;
+}
 
-	return 3;
+/*
+	userdata queue
+	string spec (See skynet-src/frame_format.h)
+	return
+		userdata queue
+ */
+static int
+lformat(lua_State *L) {
+	const char * spec = luaL_checkstring(L, 2);
+	struct frame_format f;
+	if (frame_format_parse(&f, spec)) {
+		return luaL_error(L, "Invalid header format %s", spec);
+	}
+	struct queue *q = get_queue(L);
+	q->format = f;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/*
+	userdata queue
+	integer fd
+	integer handle (nil : remove the route)
+	integer source (optional)
+	The packages of fd in the queue are sent to handle first.
+	return
+		userdata queue
+ */
+static int
+lroute(lua_State *L) {
+	int fd = luaL_checkinteger(L, 2);
+	uint32_t handle = (uint32_t)luaL_optinteger(L, 3, 0);
+	uint32_t source = (uint32_t)luaL_optinteger(L, 4, 0);
+	if (handle == 0) {
+		remove_route(lua_touserdata(L, 1), fd);
+		lua_settop(L, 1);
+		return 1;
+	}
+	struct queue *q = get_queue(L);
+	if (q->ctx == NULL) {
+		lua_getfield(L, LUA_REGISTRYINDEX, "skynet_context");
+		q->ctx = lua_touserdata(L, -1);
+		if (q->ctx == NULL) {
+			return luaL_error(L, "Init skynet context first");
+		}
+	}
+	struct route *r = find_route(q, fd);
+	if (r == NULL) {
+		int h = hash_fd(fd);
+		r = skynet_malloc(sizeof(*r));
+		r->id = fd;
+		r->next = q->route[h];
+		q->route[h] = r;
+	}
+	r->handle = handle;
+	r->source = source;
+	flush_route(q, r);
+	lua_settop(L, 1);
+	return 1;
 }
 
 /*
@@ -475,6 +723,8 @@ luaopen_skynet_netpack(lua_State *L) {
 		{ "pop", lpop },
 		{ "pack", lpack },
 		{ "clear", lclear },
+		{ "route", lroute },
+		{ "format", lformat },
 		{ "tostring", ltostring },
 		{ NULL, NULL },
 	};
@@ -488,8 +738,9 @@ luaopen_skynet_netpack(lua_State *L) {
 	lua_pushliteral(L, "close");
 	lua_pushliteral(L, "warning");
 	lua_pushliteral(L, "init");
+	lua_pushliteral(L, "drain");
 
-	lua_pushcclosure(L, lfilter, 7);
+	lua_pushcclosure(L, lfilter, 8);
 	lua_setfield(L, -2, "filter");
 
 	return 1;
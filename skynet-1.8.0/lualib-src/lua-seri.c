@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
 
 #define TYPE_NIL 0
 #define TYPE_BOOLEAN 1
@@ -30,6 +31,19 @@
 // hibits 0~31 : len
 #define TYPE_LONG_STRING 5
 #define TYPE_TABLE 6
+#define TYPE_ARRAY 7
+// homogeneous number array, hibits : element type, followed by an integer n, n elements and the hash part like TYPE_TABLE
+#define TYPE_ARRAY_INT8 1
+#define TYPE_ARRAY_INT16 2
+#define TYPE_ARRAY_INT32 4
+#define TYPE_ARRAY_INT64 8
+#define TYPE_ARRAY_REAL 16
+
+// arrays shorter than it use TYPE_TABLE
+#define MIN_PACKED_ARRAY 16
+
+// older versions can't read TYPE_ARRAY, so it's off by default (see luaseri_packarray)
+static int packed_array = 0;
 
 #define MAX_COOKIE 32
 #define COMBINE_TYPE(t,v) ((t) | (v) << 3)
@@ -37,16 +51,12 @@
 #define BLOCK_SIZE 128
 #define MAX_DEPTH 32
 
-struct block {
-	struct block * next;
-	char buffer[BLOCK_SIZE];
-};
-
+// pack into one growable buffer, the buffer is handed to the message without another copy
 struct write_block {
-	struct block * head;
-	struct block * current;
+	char * buffer;
+	int cap;
 	int len;
-	int ptr;
+	lua_State *L;	// raise the error when the buffer can't grow
 };
 
 struct read_block {
@@ -55,56 +65,47 @@ struct read_block {
 	int ptr;
 };
 
-inline static struct block *
-blk_alloc(void) {
-	struct block *b = skynet_malloc(sizeof(struct block));
-	b->next = NULL;
-	return b;
+static void wb_free(struct write_block *wb);
+
+static void
+wb_grow(struct write_block *b, int sz) {
+	int cap = b->cap;
+	if (sz > INT_MAX - b->len) {
+		wb_free(b);
+		luaL_error(b->L, "serialize can't pack too large data");
+	}
+	while (cap < b->len + sz) {
+		cap = cap > INT_MAX / 2 ? INT_MAX : cap * 2;
+	}
+	b->buffer = skynet_realloc(b->buffer, cap);
+	b->cap = cap;
 }
 
 inline static void
 wb_push(struct write_block *b, const void *buf, int sz) {
-	const char * buffer = buf;
-	if (b->ptr == BLOCK_SIZE) {
-_again:
-		b->current = b->current->next = blk_alloc();
-		b->ptr = 0;
-	}
-	if (b->ptr <= BLOCK_SIZE - sz) {
-		memcpy(b->current->buffer + b->ptr, buffer, sz);
-		b->ptr+=sz;
-		b->len+=sz;
-	} else {
-		int copy = BLOCK_SIZE - b->ptr;
-		memcpy(b->current->buffer + b->ptr, buffer, copy);
-		buffer += copy;
-		b->len += copy;
-		sz -= copy;
-		goto _again;
+	if (sz > b->cap - b->len) {
+		wb_grow(b, sz);
 	}
+	memcpy(b->buffer + b->len, buf, sz);
+	b->len += sz;
 }
 
 static void
-wb_init(struct write_block *wb , struct block *b) {
-	wb->head = b;
-	assert(b->next == NULL);
+wb_init(lua_State *L, struct write_block *wb , int cap) {
+	if (cap < BLOCK_SIZE) {
+		cap = BLOCK_SIZE;
+	}
+	wb->L = L;
+	wb->buffer = skynet_malloc(cap);
+	wb->cap = cap;
 	wb->len = 0;
-	wb->current = wb->head;
-	wb->ptr = 0;
 }
 
 static void
 wb_free(struct write_block *wb) {
-	struct block *blk = wb->head;
-	blk = blk->next;	// the first block is on stack
-	while (blk) {
-		struct block * next = blk->next;
-		skynet_free(blk);
-		blk = next;
-	}
-	wb->head = NULL;
-	wb->current = NULL;
-	wb->ptr = 0;
+	skynet_free(wb->buffer);
+	wb->buffer = NULL;
+	wb->cap = 0;
 	wb->len = 0;
 }
 
@@ -214,9 +215,124 @@ wb_string(struct write_block *wb, const char *str, int len) {
 
 static void pack_one(lua_State *L, struct write_block *b, int index, int depth);
 
+// returns TYPE_ARRAY_* if [1,n] are all integers or all floats, 0 otherwise
+static int
+array_type(lua_State *L, int index, int n) {
+	int i;
+	if (lua_rawgeti(L,index,1) != LUA_TNUMBER) {
+		lua_pop(L,1);
+		return 0;
+	}
+	if (!lua_isinteger(L,-1)) {
+		lua_pop(L,1);
+		for (i=2;i<=n;i++) {
+			int t = lua_rawgeti(L,index,i);
+			int real = t == LUA_TNUMBER && !lua_isinteger(L,-1);
+			lua_pop(L,1);
+			if (!real)
+				return 0;
+		}
+		return TYPE_ARRAY_REAL;
+	}
+	lua_Integer min = lua_tointeger(L,-1);
+	lua_Integer max = min;
+	lua_pop(L,1);
+	for (i=2;i<=n;i++) {
+		if (lua_rawgeti(L,index,i) != LUA_TNUMBER || !lua_isinteger(L,-1)) {
+			lua_pop(L,1);
+			return 0;
+		}
+		lua_Integer v = lua_tointeger(L,-1);
+		lua_pop(L,1);
+		if (v < min)
+			min = v;
+		else if (v > max)
+			max = v;
+	}
+	if (min >= INT8_MIN && max <= INT8_MAX)
+		return TYPE_ARRAY_INT8;
+	if (min >= INT16_MIN && max <= INT16_MAX)
+		return TYPE_ARRAY_INT16;
+	if (min >= INT32_MIN && max <= INT32_MAX)
+		return TYPE_ARRAY_INT32;
+	return TYPE_ARRAY_INT64;
+}
+
+static inline int
+array_width(int type) {
+	return type == TYPE_ARRAY_REAL ? sizeof(double) : type;
+}
+
+static void
+wb_packed_array(lua_State *L, struct write_block *wb, int index, int n, int type) {
+	uint8_t h = COMBINE_TYPE(TYPE_ARRAY, type);
+	wb_push(wb, &h, 1);
+	wb_integer(wb, n);
+	size_t bytes = (size_t)n * array_width(type);
+	int sz = bytes > INT_MAX ? INT_MAX : (int)bytes;	// wb_grow raises the error for INT_MAX
+	if (sz > wb->cap - wb->len) {
+		wb_grow(wb, sz);
+	}
+	char * ptr = wb->buffer + wb->len;
+	int i;
+	switch (type) {
+	case TYPE_ARRAY_REAL:
+		for (i=1;i<=n;i++) {
+			lua_rawgeti(L,index,i);
+			double v = lua_tonumber(L,-1);
+			lua_pop(L,1);
+			memcpy(ptr, &v, sizeof(v));
+			ptr += sizeof(v);
+		}
+		break;
+	case TYPE_ARRAY_INT8:
+		for (i=1;i<=n;i++) {
+			lua_rawgeti(L,index,i);
+			*ptr++ = (int8_t)lua_tointeger(L,-1);
+			lua_pop(L,1);
+		}
+		break;
+	case TYPE_ARRAY_INT16:
+		for (i=1;i<=n;i++) {
+			lua_rawgeti(L,index,i);
+			int16_t v = (int16_t)lua_tointeger(L,-1);
+			lua_pop(L,1);
+			memcpy(ptr, &v, sizeof(v));
+			ptr += sizeof(v);
+		}
+		break;
+	case TYPE_ARRAY_INT32:
+		for (i=1;i<=n;i++) {
+			lua_rawgeti(L,index,i);
+			int32_t v = (int32_t)lua_tointeger(L,-1);
+			lua_pop(L,1);
+			memcpy(ptr, &v, sizeof(v));
+			ptr += sizeof(v);
+		}
+		break;
+	default:
+		for (i=1;i<=n;i++) {
+			lua_rawgeti(L,index,i);
+			int64_t v = lua_tointeger(L,-1);
+			lua_pop(L,1);
+			memcpy(ptr, &v, sizeof(v));
+			ptr += sizeof(v);
+		}
+		break;
+	}
+	wb->len += sz;
+}
+
 static int
 wb_table_array(lua_State *L, struct write_block * wb, int index, int depth) {
 	int array_size = lua_rawlen(L,index);
+	if (packed_array && array_size >= MIN_PACKED_ARRAY) {
+		int type = array_type(L, index, array_size);
+		if (type) {
+			wb_packed_array(L, wb, index, array_size, type);
+			return array_size;
+		}
+	}
 	if (array_size >= MAX_COOKIE-1) {
 		uint8_t n = COMBINE_TYPE(TYPE_TABLE, MAX_COOKIE-1);
 		wb_push(wb, &n, 1);
@@ -358,6 +474,105 @@ pack_from(lua_State *L, struct write_block *b, int from) {
 	}
 }
 
+static size_t
+estimate_integer(lua_Integer v) {
+	if (v == 0) {
+		return 1;
+	} else if (v != (int32_t)v) {
+		return 1 + sizeof(int64_t);
+	} else if (v < 0) {
+		return 1 + sizeof(int32_t);
+	} else if (v<0x100) {
+		return 1 + sizeof(uint8_t);
+	} else if (v<0x10000) {
+		return 1 + sizeof(uint16_t);
+	} else {
+		return 1 + sizeof(uint32_t);
+	}
+}
+
+static size_t estimate_one(lua_State *L, int index, int depth);
+
+// exact size of what pack_one writes, except tables with __pairs (guess BLOCK_SIZE)
+static size_t
+estimate_table(lua_State *L, int index, int depth) {
+	if (!lua_checkstack(L, LUA_MINSTACK)) {
+		return BLOCK_SIZE;
+	}
+	if (luaL_getmetafield(L, index, "__pairs") != LUA_TNIL) {
+		lua_pop(L, 1);
+		return BLOCK_SIZE;
+	}
+	int array_size = lua_rawlen(L,index);
+	size_t sz = 1;
+	int type = 0;
+	if (packed_array && array_size >= MIN_PACKED_ARRAY) {
+		type = array_type(L, index, array_size);
+	}
+	if (type) {
+		sz += estimate_integer(array_size) + (size_t)array_size * array_width(type);
+	} else {
+		if (array_size >= MAX_COOKIE-1) {
+			sz += estimate_integer(array_size);
+		}
+		int i;
+		for (i=1;i<=array_size;i++) {
+			lua_rawgeti(L,index,i);
+			sz += estimate_one(L, lua_gettop(L), depth);
+			lua_pop(L,1);
+		}
+	}
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		if (lua_isinteger(L, -2)) {
+			lua_Integer x = lua_tointeger(L,-2);
+			if (x>0 && x<=array_size) {
+				lua_pop(L,1);
+				continue;
+			}
+		}
+		int top = lua_gettop(L);
+		sz += estimate_one(L, top-1, depth);
+		sz += estimate_one(L, top, depth);
+		lua_pop(L, 1);
+	}
+	return sz + 1;
+}
+
+static size_t
+estimate_one(lua_State *L, int index, int depth) {
+	if (depth > MAX_DEPTH) {
+		// the same error as pack_one, stop walking the (maybe recursive) tables
+		luaL_error(L, "serialize can't pack too depth table");
+	}
+	switch(lua_type(L,index)) {
+	case LUA_TNIL:
+	case LUA_TBOOLEAN:
+		return 1;
+	case LUA_TNUMBER:
+		if (lua_isinteger(L, index)) {
+			return estimate_integer(lua_tointeger(L,index));
+		}
+		return 1 + sizeof(double);
+	case LUA_TSTRING: {
+		size_t len = lua_rawlen(L,index);
+		if (len < MAX_COOKIE) {
+			return 1 + len;
+		} else if (len < 0x10000) {
+			return 3 + len;
+		} else {
+			return 5 + len;
+		}
+	}
+	case LUA_TLIGHTUSERDATA:
+		return 1 + sizeof(void *);
+	case LUA_TTABLE:
+		return estimate_table(L, index, depth+1);
+	default:
+		return 0;
+	}
+}
+
 static inline void
 invalid_stream_line(lua_State *L, struct read_block *rb, int line) {
 	int len = rb->len;
@@ -441,20 +656,42 @@ get_buffer(lua_State *L, struct read_block *rb, int len) {
 
 static void unpack_one(lua_State *L, struct read_block *rb);
 
+static int
+get_size(lua_State *L, struct read_block *rb) {
+	uint8_t type;
+	const uint8_t * t = (const uint8_t *)rb_read(rb, sizeof(type));
+	if (t==NULL) {
+		invalid_stream(L,rb);
+	}
+	type = *t;
+	int cookie = type >> 3;
+	if ((type & 7) != TYPE_NUMBER || cookie == TYPE_NUMBER_REAL) {
+		invalid_stream(L,rb);
+	}
+	lua_Integer n = get_integer(L,rb,cookie);
+	if (n < 0 || n > INT_MAX) {
+		invalid_stream(L,rb);
+	}
+	return (int)n;
+}
+
+static void
+unpack_hash(lua_State *L, struct read_block *rb) {
+	for (;;) {
+		unpack_one(L,rb);
+		if (lua_isnil(L,-1)) {
+			lua_pop(L,1);
+			return;
+		}
+		unpack_one(L,rb);
+		lua_rawset(L,-3);
+	}
+}
+
 static void
 unpack_table(lua_State *L, struct read_block *rb, int array_size) {
 	if (array_size == MAX_COOKIE-1) {
-		uint8_t type;
-		const uint8_t * t = (const uint8_t *)rb_read(rb, sizeof(type));
-		if (t==NULL) {
-			invalid_stream(L,rb);
-		}
-		type = *t;
-		int cookie = type >> 3;
-		if ((type & 7) != TYPE_NUMBER || cookie == TYPE_NUMBER_REAL) {
-			invalid_stream(L,rb);
-		}
-		array_size = get_integer(L,rb,cookie);
+		array_size = get_size(L,rb);
 	}
 	luaL_checkstack(L,LUA_MINSTACK,NULL);
 	lua_createtable(L,array_size,0);
@@ -463,15 +700,70 @@ unpack_table(lua_State *L, struct read_block *rb, int array_size) {
 		unpack_one(L,rb);
 		lua_rawseti(L,-2,i);
 	}
-	for (;;) {
-		unpack_one(L,rb);
-		if (lua_isnil(L,-1)) {
-			lua_pop(L,1);
-			return;
+	unpack_hash(L,rb);
+}
+
+static void
+unpack_array(lua_State *L, struct read_block *rb, int type) {
+	if (type != TYPE_ARRAY_INT8 && type != TYPE_ARRAY_INT16 && type != TYPE_ARRAY_INT32 &&
+		type != TYPE_ARRAY_INT64 && type != TYPE_ARRAY_REAL) {
+		invalid_stream(L,rb);
+	}
+	int n = get_size(L,rb);
+	int width = array_width(type);
+	if (n > rb->len / width) {
+		invalid_stream(L,rb);
+	}
+	// one bounds check for the whole array
+	const char * ptr = (const char *)rb_read(rb, n * width);
+	luaL_checkstack(L,LUA_MINSTACK,NULL);
+	lua_createtable(L,n,0);
+	int i;
+	switch (type) {
+	case TYPE_ARRAY_REAL:
+		for (i=1;i<=n;i++) {
+			double v;
+			memcpy(&v, ptr, sizeof(v));
+			ptr += sizeof(v);
+			lua_pushnumber(L,v);
+			lua_rawseti(L,-2,i);
 		}
-		unpack_one(L,rb);
-		lua_rawset(L,-3);
+		break;
+	case TYPE_ARRAY_INT8:
+		for (i=1;i<=n;i++) {
+			lua_pushinteger(L,(int8_t)ptr[i-1]);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	case TYPE_ARRAY_INT16:
+		for (i=1;i<=n;i++) {
+			int16_t v;
+			memcpy(&v, ptr, sizeof(v));
+			ptr += sizeof(v);
+			lua_pushinteger(L,v);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	case TYPE_ARRAY_INT32:
+		for (i=1;i<=n;i++) {
+			int32_t v;
+			memcpy(&v, ptr, sizeof(v));
+			ptr += sizeof(v);
+			lua_pushinteger(L,v);
+			lua_rawseti(L,-2,i);
+		}
+		break;
+	default:
+		for (i=1;i<=n;i++) {
+			int64_t v;
+			memcpy(&v, ptr, sizeof(v));
+			ptr += sizeof(v);
+			lua_pushinteger(L,v);
+			lua_rawseti(L,-2,i);
+		}
+		break;
 	}
+	unpack_hash(L,rb);
 }
 
 static void
@@ -523,6 +815,10 @@ push_value(lua_State *L, struct read_block *rb, int type, int cookie) {
 		unpack_table(L,rb,cookie);
 		break;
 	}
+	case TYPE_ARRAY: {
+		unpack_array(L,rb,cookie);
+		break;
+	}
 	default: {
 		invalid_stream(L,rb);
 		break;
@@ -542,24 +838,9 @@ unpack_one(lua_State *L, struct read_block *rb) {
 }
 
 static void
-seri(lua_State *L, struct block *b, int len) {
-	uint8_t * buffer = skynet_malloc(len);
-	uint8_t * ptr = buffer;
-	int sz = len;
-	while(len>0) {
-		if (len >= BLOCK_SIZE) {
-			memcpy(ptr, b->buffer, BLOCK_SIZE);
-			ptr += BLOCK_SIZE;
-			len -= BLOCK_SIZE;
-			b = b->next;
-		} else {
-			memcpy(ptr, b->buffer, len);
-			break;
-		}
-	}
-	
-	lua_pushlightuserdata(L, buffer);
-	lua_pushinteger(L, sz);
+seri(lua_State *L, struct write_block *wb) {
+	lua_pushlightuserdata(L, wb->buffer);
+	lua_pushinteger(L, wb->len);
 }
 
 int
@@ -606,17 +887,49 @@ luaseri_unpack(lua_State *L) {
 	return lua_gettop(L) - 1;
 }
 
+void
+luaseri_packarray(int enable) {
+	packed_array = enable;
+}
+
 LUAMOD_API int
 luaseri_pack(lua_State *L) {
-	struct block temp;
-	temp.next = NULL;
 	struct write_block wb;
-	wb_init(&wb, &temp);
+	wb_init(L, &wb, BLOCK_SIZE);
 	pack_from(L,&wb,0);
-	assert(wb.head == &temp);
-	seri(L, &temp, wb.len);
+	seri(L, &wb);
+
+	return 2;
+}
+
+// packhint(sz, ...) : sz is the expected size from the caller
+LUAMOD_API int
+luaseri_packhint(lua_State *L) {
+	int hint = luaL_checkinteger(L, 1);
+	struct write_block wb;
+	wb_init(L, &wb, hint);
+	pack_from(L,&wb,1);
+	seri(L, &wb);
+
+	return 2;
+}
 
-	wb_free(&wb);
+// packestimate(...) : walk the values first to allocate the buffer once
+LUAMOD_API int
+luaseri_packestimate(lua_State *L) {
+	int n = lua_gettop(L);
+	size_t sz = 0;
+	int i;
+	for (i=1;i<=n;i++) {
+		sz += estimate_one(L, i, 0);
+	}
+	if (sz > INT_MAX) {
+		return luaL_error(L, "serialize can't pack too large data");
+	}
+	struct write_block wb;
+	wb_init(L, &wb, (int)sz);
+	pack_from(L,&wb,0);
+	seri(L, &wb);
 
 	return 2;
 }
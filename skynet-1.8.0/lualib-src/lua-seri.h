@@ -5,5 +5,8 @@
 
 int luaseri_pack(lua_State *L);
 int luaseri_unpack(lua_State *L);
+int luaseri_packhint(lua_State *L);
+int luaseri_packestimate(lua_State *L);
+void luaseri_packarray(int enable);
 
 #endif
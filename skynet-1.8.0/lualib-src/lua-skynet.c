@@ -135,6 +135,8 @@ lcallback(lua_State *L) {
 	lua_xmove(L, cb_ctx->L, 1);
 
 	skynet_callback(context, cb_ctx, (forward)?(_forward_pre):(_cb_pre));
+	// forward mode reserves the messages
+	skynet_callback_shared(context, !forward);
 	return 0;
 }
 
@@ -242,6 +244,11 @@ get_dest_string(lua_State *L, int index) {
 	return dest_string;
 }
 
+struct shared_payload {
+	void * msg;
+	size_t sz;
+};
+
 static int
 send_message(lua_State *L, int source, int idx_type) {
 	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
@@ -287,6 +294,16 @@ send_message(lua_State *L, int source, int idx_type) {
 		}
 		break;
 	}
+	case LUA_TUSERDATA: {
+		struct shared_payload * sp = luaL_checkudata(L, idx_type+2, "SKYNET_SHARED");
+		skynet_shared_grab(sp->msg);
+		if (dest_string) {
+			session = skynet_sendname(context, source, dest_string, type | PTYPE_TAG_SHARED, session, sp->msg, sp->sz);
+		} else {
+			session = skynet_send(context, source, dest, type | PTYPE_TAG_SHARED, session, sp->msg, sp->sz);
+		}
+		break;
+	}
 	default:
 		luaL_error(L, "invalid param %s", lua_typename(L, lua_type(L,idx_type+2)));
 	}
@@ -392,6 +409,164 @@ lpackstring(lua_State *L) {
 	return 1;
 }
 
+static int
+lshared_gc(lua_State *L) {
+	struct shared_payload * sp = lua_touserdata(L, 1);
+	if (sp->msg) {
+		skynet_shared_release(sp->msg);
+		sp->msg = NULL;
+	}
+	return 0;
+}
+
+// pack once into a refcounted buffer, send it to many services by skynet.rawsend/rawcall
+static int
+lsharedpack(lua_State *L) {
+	luaseri_pack(L);
+	void * buffer = lua_touserdata(L, -2);
+	size_t sz = lua_tointeger(L, -1);
+	struct shared_payload * sp = lua_newuserdatauv(L, sizeof(*sp), 0);
+	sp->msg = skynet_shared_new(sz);
+	sp->sz = sz;
+	memcpy(sp->msg, buffer, sz);
+	skynet_free(buffer);
+	if (luaL_newmetatable(L, "SKYNET_SHARED")) {
+		lua_pushcfunction(L, lshared_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+// responses of skynet.callall, copied into one buffer without creating lua strings
+
+#define GATHER_NONE -1
+#define GATHER_ERROR -2
+
+struct gather_item {
+	size_t offset;
+	int sz;	// GATHER_NONE : not arrived yet, GATHER_ERROR : failed
+};
+
+struct gather {
+	int n;
+	int pending;
+	size_t len;
+	size_t cap;
+	char * buffer;
+	struct gather_item item[1];
+};
+
+static struct gather_item *
+gather_item(lua_State *L, struct gather *g) {
+	int index = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, index >= 1 && index <= g->n, 2, "index out of range");
+	return &g->item[index-1];
+}
+
+// g:put(index, msg, sz) , returns the number of pending responses
+static int
+lgather_put(lua_State *L) {
+	struct gather * g = luaL_checkudata(L, 1, "SKYNET_GATHER");
+	struct gather_item * item = gather_item(L, g);
+	if (item->sz == GATHER_NONE) {
+		const char * msg = lua_touserdata(L, 3);
+		size_t sz = luaL_checkinteger(L, 4);
+		if (g->len + sz > g->cap) {
+			size_t cap = g->cap * 2;
+			while (cap < g->len + sz) {
+				cap *= 2;
+			}
+			g->buffer = skynet_realloc(g->buffer, cap);
+			g->cap = cap;
+		}
+		memcpy(g->buffer + g->len, msg, sz);
+		item->offset = g->len;
+		item->sz = (int)sz;
+		g->len += sz;
+		--g->pending;
+	}
+	lua_pushinteger(L, g->pending);
+	return 1;
+}
+
+// g:fail(index) , returns the number of pending responses
+static int
+lgather_fail(lua_State *L) {
+	struct gather * g = luaL_checkudata(L, 1, "SKYNET_GATHER");
+	struct gather_item * item = gather_item(L, g);
+	if (item->sz == GATHER_NONE) {
+		item->sz = GATHER_ERROR;
+		--g->pending;
+	}
+	lua_pushinteger(L, g->pending);
+	return 1;
+}
+
+// g:get(index) returns msg, sz ; false for failed ; nil for no response. msg is valid until g is collected
+static int
+lgather_get(lua_State *L) {
+	struct gather * g = luaL_checkudata(L, 1, "SKYNET_GATHER");
+	struct gather_item * item = gather_item(L, g);
+	if (item->sz == GATHER_NONE) {
+		return 0;
+	} else if (item->sz == GATHER_ERROR) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	lua_pushlightuserdata(L, g->buffer + item->offset);
+	lua_pushinteger(L, item->sz);
+	return 2;
+}
+
+static int
+lgather_pending(lua_State *L) {
+	struct gather * g = luaL_checkudata(L, 1, "SKYNET_GATHER");
+	lua_pushinteger(L, g->pending);
+	return 1;
+}
+
+static int
+lgather_gc(lua_State *L) {
+	struct gather * g = lua_touserdata(L, 1);
+	skynet_free(g->buffer);
+	g->buffer = NULL;
+	return 0;
+}
+
+static int
+lgather(lua_State *L) {
+	int n = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, n >= 0, 1, "invalid size");
+	size_t sz = sizeof(struct gather) + (n > 0 ? n - 1 : 0) * sizeof(struct gather_item);
+	struct gather * g = lua_newuserdatauv(L, sz, 0);
+	g->n = n;
+	g->pending = n;
+	g->len = 0;
+	g->cap = 256;
+	g->buffer = skynet_malloc(g->cap);
+	int i;
+	for (i=0;i<n;i++) {
+		g->item[i].offset = 0;
+		g->item[i].sz = GATHER_NONE;
+	}
+	if (luaL_newmetatable(L, "SKYNET_GATHER")) {
+		luaL_Reg l[] = {
+			{ "put", lgather_put },
+			{ "fail", lgather_fail },
+			{ "get", lgather_get },
+			{ "pending", lgather_pending },
+			{ NULL, NULL },
+		};
+		luaL_newlib(L, l);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, lgather_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
 static int
 ltrash(lua_State *L) {
 	int t = lua_type(L,1);
@@ -515,7 +690,11 @@ luaopen_skynet_core(lua_State *L) {
 		{ "tostring", ltostring },
 		{ "pack", luaseri_pack },
 		{ "unpack", luaseri_unpack },
+		{ "packhint", luaseri_packhint },
+		{ "packestimate", luaseri_packestimate },
 		{ "packstring", lpackstring },
+		{ "sharedpack", lsharedpack },
+		{ "gather", lgather },
 		{ "trash" , ltrash },
 		{ "now", lnow },
 		{ "hpc", lhpc },	// getHPCounter
@@ -530,6 +709,9 @@ luaopen_skynet_core(lua_State *L) {
 		return luaL_error(L, "Init skynet context first");
 	}
 
+	// packarray = true in config : pack the number arrays as TYPE_ARRAY, all the peers should be able to read it
+	const char * packarray = skynet_command(ctx, "GETENV", "packarray");
+	luaseri_packarray(packarray && strcmp(packarray, "true") == 0);
 
 	luaL_setfuncs(L,l,1);
 
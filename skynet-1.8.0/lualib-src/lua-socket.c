@@ -487,8 +487,14 @@ llisten(lua_State *L) {
 	const char * host = luaL_checkstring(L,1);
 	int port = luaL_checkinteger(L,2);
 	int backlog = luaL_optinteger(L,3,BACKLOG);
+	int reuseport = lua_toboolean(L,4);
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
-	int id = skynet_socket_listen(ctx, host,port,backlog);
+	int id;
+	if (reuseport) {
+		id = skynet_socket_listen_reuseport(ctx, host,port,backlog);
+	} else {
+		id = skynet_socket_listen(ctx, host,port,backlog);
+	}
 	if (id < 0) {
 		return luaL_error(L, "Listen error");
 	}
@@ -578,6 +584,21 @@ get_buffer(lua_State *L, int index, struct socket_sendbuffer *buf) {
 	}
 }
 
+/*
+	return
+		boolean ok
+		boolean block (the send buffer is over the high watermark, See lflowcontrol)
+ */
+static int
+send_result(lua_State *L, int err) {
+	lua_pushboolean(L, err >= 0);
+	if (err > 0) {
+		lua_pushboolean(L, 1);
+		return 2;
+	}
+	return 1;
+}
+
 static int
 lsend(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -586,8 +607,7 @@ lsend(lua_State *L) {
 	buf.id = id;
 	get_buffer(L, 2, &buf);
 	int err = skynet_socket_sendbuffer(ctx, &buf);
-	lua_pushboolean(L, !err);
-	return 1;
+	return send_result(L, err);
 }
 
 static int
@@ -598,7 +618,32 @@ lsendlow(lua_State *L) {
 	buf.id = id;
 	get_buffer(L, 2, &buf);
 	int err = skynet_socket_sendbuffer_lowpriority(ctx, &buf);
-	lua_pushboolean(L, !err);
+	return send_result(L, err);
+}
+
+/*
+	table ids
+	string / lightuserdata msg / table strings
+	integer sz (for lightuserdata)
+
+	return the number of sockets the msg is sent to
+ */
+static int
+lbroadcast(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int n = lua_rawlen(L, 1);
+	int *ids = lua_newuserdatauv(L, (n > 0 ? n : 1) * sizeof(int), 0);
+	int i;
+	for (i=0;i<n;i++) {
+		lua_rawgeti(L, 1, i+1);
+		ids[i] = luaL_checkinteger(L, -1);
+		lua_pop(L, 1);
+	}
+	struct socket_sendbuffer buf;
+	buf.id = 0;
+	get_buffer(L, 2, &buf);
+	lua_pushinteger(L, skynet_socket_sendbuffer_shared(ctx, ids, n, &buf));
 	return 1;
 }
 
@@ -635,6 +680,35 @@ lnodelay(lua_State *L) {
 	return 0;
 }
 
+/*
+	integer id
+	integer high (0 : disable)
+	integer low (optional, high/2 by default)
+	boolean droplow (optional)
+ */
+static int
+lflowcontrol(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	lua_Integer high = luaL_checkinteger(L, 2);
+	lua_Integer low = luaL_optinteger(L, 3, -1);
+	int droplow = lua_toboolean(L, 4);
+	skynet_socket_flowcontrol(ctx, id, high, low, droplow);
+	return 0;
+}
+
+/*
+	integer id
+	return boolean : the send buffer is over the high watermark and hasn't drained yet
+ */
+static int
+lblocked(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	lua_pushboolean(L, skynet_socket_blocked(ctx, id));
+	return 1;
+}
+
 static int
 ludp(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -675,6 +749,19 @@ ludp_connect(lua_State *L) {
 	return 0;
 }
 
+/*
+	integer id
+	boolean enable (optional, true by default)
+ */
+static int
+ludp_batch(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int enable = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+	skynet_socket_udp_batch(ctx, id, enable);
+	return 0;
+}
+
 static int
 ludp_dial(lua_State *L){
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -728,6 +815,37 @@ ludp_send(lua_State *L) {
 	return 1;
 }
 
+/*
+	lightuserdata msg (SKYNET_SOCKET_TYPE_UDPBATCH)
+	integer count
+
+	return { data1, address1, data2, address2, ... }
+ */
+static int
+ludp_unpack(lua_State *L) {
+	const uint8_t * ptr = lua_touserdata(L, 1);
+	if (ptr == NULL) {
+		return luaL_error(L, "Need udp batch message");
+	}
+	int count = luaL_checkinteger(L, 2);
+	lua_createtable(L, count * 2, 0);
+	int i;
+	for (i=0;i<count;i++) {
+		uint32_t sz;
+		memcpy(&sz, ptr, sizeof(sz));
+		ptr += sizeof(sz);
+		int addrsz = ptr[0];
+		const uint8_t * address = ptr + 1;
+		ptr += 1 + addrsz;
+		lua_pushlstring(L, (const char *)ptr, sz);
+		lua_rawseti(L, -2, i*2+1);
+		lua_pushlstring(L, (const char *)address, addrsz);
+		lua_rawseti(L, -2, i*2+2);
+		ptr += sz;
+	}
+	return 1;
+}
+
 static int
 ludp_address(lua_State *L) {
 	size_t sz = 0;
@@ -802,6 +920,10 @@ getinfo(lua_State *L, struct socket_info *si) {
 	lua_setfield(L, -2, "rtime");
 	lua_pushinteger(L, si->wtime);
 	lua_setfield(L, -2, "wtime");
+	lua_pushinteger(L, si->rcall);
+	lua_setfield(L, -2, "rcall");
+	lua_pushinteger(L, si->wcall);
+	lua_setfield(L, -2, "wcall");
 	lua_pushboolean(L, si->reading);
 	lua_setfield(L, -2, "reading");
 	lua_pushboolean(L, si->writing);
@@ -869,6 +991,7 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "str2p", lstr2p },
 		{ "header", lheader },
 		{ "info", linfo },
+		{ "udp_unpack", ludp_unpack },
 
 		{ "unpack", lunpack },
 		{ NULL, NULL },
@@ -881,12 +1004,16 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "listen", llisten },
 		{ "send", lsend },
 		{ "lsend", lsendlow },
+		{ "broadcast", lbroadcast },
 		{ "bind", lbind },
 		{ "start", lstart },
 		{ "pause", lpause },
 		{ "nodelay", lnodelay },
+		{ "flowcontrol", lflowcontrol },
+		{ "blocked", lblocked },
 		{ "udp", ludp },
 		{ "udp_connect", ludp_connect },
+		{ "udp_batch", ludp_batch },
 		{ "udp_dial", ludp_dial},
 		{ "udp_listen", ludp_listen},
 		{ "udp_send", ludp_send },
@@ -0,0 +1,186 @@
+#include "lz4block.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MINMATCH 4
+#define LASTLITERALS 5	// the last 5 bytes are always literals
+#define MFLIMIT 12	// the last match must start at least 12 bytes before the end
+#define MAX_DISTANCE 65535
+#define ML_BITS 4
+#define ML_MASK ((1U<<ML_BITS)-1)
+#define RUN_MASK ML_MASK
+#define HASH_LOG 12
+#define SKIP_TRIGGER 6	// skip faster on incompressible data
+
+static inline uint32_t
+read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t
+hash32(uint32_t v) {
+	return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static inline uint8_t *
+write_length(uint8_t *op, size_t len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+static uint8_t *
+write_literals(uint8_t *op, uint8_t *token, const uint8_t *anchor, size_t litlen) {
+	if (litlen >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = write_length(op, litlen - RUN_MASK);
+	} else {
+		*token = (uint8_t)(litlen << ML_BITS);
+	}
+	memcpy(op, anchor, litlen);
+	return op + litlen;
+}
+
+int
+lz4block_compress(const char *source, char *dest, int isize, int maxOutputSize) {
+	if ((unsigned)isize > LZ4BLOCK_MAX_INPUT_SIZE || maxOutputSize <= 0)
+		return 0;
+	const uint8_t *src = (const uint8_t *)source;
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *iend = src + isize;
+	const uint8_t *mflimit = iend - MFLIMIT;
+	const uint8_t *matchlimit = iend - LASTLITERALS;
+	uint8_t *op = (uint8_t *)dest;
+	uint8_t *oend = op + maxOutputSize;
+	uint32_t table[1<<HASH_LOG];	// position + 1, 0 for empty
+
+	if (isize >= MFLIMIT + 1) {
+		memset(table, 0, sizeof(table));
+		unsigned search = 1 << SKIP_TRIGGER;
+		while (ip < mflimit) {
+			uint32_t seq = read32(ip);
+			uint32_t h = hash32(seq);
+			uint32_t pos = table[h];
+			table[h] = (uint32_t)(ip - src) + 1;
+			const uint8_t *ref = src + pos - 1;
+			if (pos == 0 || ip - ref > MAX_DISTANCE || read32(ref) != seq) {
+				ip += search++ >> SKIP_TRIGGER;
+				continue;
+			}
+			search = 1 << SKIP_TRIGGER;
+			// extend backward
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				--ip;
+				--ref;
+			}
+			const uint8_t *mp = ip + MINMATCH;
+			const uint8_t *rp = ref + MINMATCH;
+			while (mp < matchlimit && *mp == *rp) {
+				++mp;
+				++rp;
+			}
+			size_t litlen = ip - anchor;
+			size_t mlen = mp - ip - MINMATCH;
+			// token + literal length + literals + offset + match length
+			if (op + 1 + litlen / 255 + 1 + litlen + 2 + mlen / 255 + 1 > oend)
+				return 0;
+			uint8_t *token = op++;
+			op = write_literals(op, token, anchor, litlen);
+			uint16_t offset = (uint16_t)(ip - ref);
+			*op++ = offset & 0xff;
+			*op++ = offset >> 8;
+			if (mlen >= ML_MASK) {
+				*token |= ML_MASK;
+				op = write_length(op, mlen - ML_MASK);
+			} else {
+				*token |= (uint8_t)mlen;
+			}
+			ip = mp;
+			anchor = ip;
+			if (ip < mflimit) {
+				// fill the table with the position before the next search
+				table[hash32(read32(ip - 2))] = (uint32_t)(ip - 2 - src) + 1;
+			}
+		}
+	}
+	// last literals
+	size_t litlen = iend - anchor;
+	if (op + 1 + litlen / 255 + 1 + litlen > oend)
+		return 0;
+	uint8_t *token = op++;
+	op = write_literals(op, token, anchor, litlen);
+	return (int)(op - (uint8_t *)dest);
+}
+
+static inline int
+read_length(const uint8_t **pip, const uint8_t *iend, size_t *len) {
+	const uint8_t *ip = *pip;
+	unsigned s;
+	do {
+		if (ip >= iend)
+			return -1;
+		s = *ip++;
+		*len += s;
+	} while (s == 255);
+	*pip = ip;
+	return 0;
+}
+
+int
+lz4block_decompress(const char *source, char *dest, int compressedSize, int maxDecompressedSize) {
+	if (compressedSize <= 0 || maxDecompressedSize < 0)
+		return -1;
+	const uint8_t *ip = (const uint8_t *)source;
+	const uint8_t *iend = ip + compressedSize;
+	uint8_t *op = (uint8_t *)dest;
+	uint8_t *ostart = op;
+	uint8_t *oend = op + maxDecompressedSize;
+
+	for (;;) {
+		if (ip >= iend)
+			return -1;
+		unsigned token = *ip++;
+		size_t len = token >> ML_BITS;
+		if (len == RUN_MASK && read_length(&ip, iend, &len))
+			return -1;
+		if (len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+			return -1;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+		if (ip == iend)
+			break;	// the last sequence has literals only
+		if (iend - ip < 2)
+			return -1;
+		size_t offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - ostart))
+			return -1;
+		len = token & ML_MASK;
+		if (len == ML_MASK && read_length(&ip, iend, &len))
+			return -1;
+		len += MINMATCH;
+		if (len > (size_t)(oend - op))
+			return -1;
+		const uint8_t *match = op - offset;
+		if (offset >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else {
+			// overlapped copy
+			size_t i;
+			for (i=0;i<len;i++) {
+				op[i] = match[i];
+			}
+			op += len;
+		}
+	}
+	return (int)(op - ostart);
+}
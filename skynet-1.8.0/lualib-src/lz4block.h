@@ -0,0 +1,18 @@
+#ifndef SKYNET_LZ4BLOCK_H
+#define SKYNET_LZ4BLOCK_H
+
+/*
+	A small codec of the LZ4 block format, the output can be read by the reference lz4 library, and vice versa :
+	https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+	There is no frame format and no dictionary, it's used by lualib-src/lua-cluster.c
+ */
+
+#define LZ4BLOCK_MAX_INPUT_SIZE 0x7E000000
+
+// returns the compressed size, or 0 if dstCapacity is not enough
+int lz4block_compress(const char* src, char* dst, int srcSize, int dstCapacity);
+
+// returns the decompressed size, or a negative number if src is malformed
+int lz4block_decompress(const char* src, char* dst, int compressedSize, int dstCapacity);
+
+#endif
@@ -3,6 +3,12 @@ for word in string.gmatch(..., "%S+") do
 	table.insert(args, word)
 end
 
+-- "@template name" warms a service, and returns its main for the real args (see service/launcher.lua)
+local template = args[1] == "@template"
+if template then
+	table.remove(args, 1)
+end
+
 SERVICE_NAME = args[1]
 
 local main, pattern
@@ -47,4 +53,16 @@ end
 
 _G.require = (require "skynet.require").require
 
+if template then
+	require "skynet"
+	return function(param)
+		args = {}
+		for word in string.gmatch(param, "%S+") do
+			table.insert(args, word)
+		end
+		assert(args[1] == SERVICE_NAME)
+		main(select(2, table.unpack(args)))
+	end
+end
+
 main(select(2, table.unpack(args)))
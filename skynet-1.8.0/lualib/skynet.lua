@@ -42,6 +42,7 @@ local skynet = {
 	PTYPE_LUA = 10,
 	PTYPE_SNAX = 11,
 	PTYPE_TRACE = 12,	-- use for debug trace
+	PTYPE_BATCH = 13,	-- see skynet.callbatch
 }
 
 -- code cache
@@ -328,6 +329,67 @@ do ---- request/select
 	end
 end
 
+local new_batch, msg_tostring
+do ---- batch response
+	local batch_meta = {}	; batch_meta.__index = batch_meta
+
+	function msg_tostring(msg, sz)
+		if sz == nil then
+			return msg
+		end
+		local str = c.tostring(msg, sz)
+		c.trash(msg, sz)
+		return str
+	end
+
+	-- the response of item index, the batch replies once when all the items are done
+	function batch_meta:reply(index, ptype, msg, sz)
+		local resp = self.resp
+		if resp[index] ~= nil then
+			if sz then
+				c.trash(msg, sz)
+			end
+			return false
+		end
+		if ptype == skynet.PTYPE_RESPONSE then
+			resp[index] = msg_tostring(msg, sz)
+		else
+			resp[index] = false
+		end
+		local pending = self.pending - 1
+		self.pending = pending
+		if pending == 0 then
+			if c.send(self.source, skynet.PTYPE_RESPONSE, self.session, c.pack(resp)) == false then
+				c.send(self.source, skynet.PTYPE_ERROR, self.session, "")
+			end
+		end
+		return true
+	end
+
+	function new_batch(source, session, n)
+		local batch = setmetatable({ source = source, session = session, pending = n, resp = {} }, batch_meta)
+		if n == 0 then
+			c.send(source, skynet.PTYPE_RESPONSE, session, c.pack(batch.resp))
+		end
+		return batch
+	end
+end
+
+-- the address of a request is a batch object when it comes from skynet.callbatch
+local function response_send(addr, ptype, session, msg, sz)
+	if type(addr) == "table" then
+		return addr:reply(session, ptype, msg, sz)
+	end
+	return c.send(addr, ptype, session, msg, sz)
+end
+
+local function response_source(addr)
+	if type(addr) == "table" then
+		return addr.source
+	end
+	return addr
+end
+
 -- suspend is function
 local suspend
 
@@ -338,6 +400,10 @@ local function dispatch_error_queue()
 	if session then
 		local co = session_id_coroutine[session]
 		session_id_coroutine[session] = nil
+		if type(co) == "table" then
+			-- see skynet.callall
+			return co:response(session, false)
+		end
 		return suspend(co, coroutine_resume(co, false, nil, nil, session))
 	end
 end
@@ -366,43 +432,58 @@ end
 
 -- coroutine reuse
 
-local coroutine_pool = setmetatable({}, { __mode = "kv" })
+local coroutine_pool = {}
+local coroutine_pool_min = tonumber((c.command("GETENV", "coroutine_pool_min"))) or 0
+local coroutine_pool_max = tonumber((c.command("GETENV", "coroutine_pool_max"))) or 64
+local coroutine_pool_hit = 0
+local coroutine_pool_miss = 0
+
+local function co_new(f)
+	local co
+	co = coroutine_create(function(...)
+		f(...)
+		while true do
+			local session = session_coroutine_id[co]
+			if session and session ~= 0 then
+				local source = debug.getinfo(f,"S")
+				skynet.error(string.format("Maybe forgot response session %s from %s : %s:%d",
+					session,
+					skynet.address(response_source(session_coroutine_address[co])),
+					source.source, source.linedefined))
+			end
+			-- coroutine exit
+			local tag = session_coroutine_tracetag[co]
+			if tag ~= nil then
+				if tag then c.trace(tag, "end")	end
+				session_coroutine_tracetag[co] = nil
+			end
+			local address = session_coroutine_address[co]
+			if address then
+				session_coroutine_id[co] = nil
+				session_coroutine_address[co] = nil
+			end
+
+			-- recycle co into pool
+			f = nil
+			if #coroutine_pool >= coroutine_pool_max then
+				return "SUSPEND"
+			end
+			coroutine_pool[#coroutine_pool+1] = co
+			-- recv new main function f
+			f = coroutine_yield "SUSPEND"
+			f(coroutine_yield())
+		end
+	end)
+	return co
+end
 
 local function co_create(f)
 	local co = tremove(coroutine_pool)
 	if co == nil then
-		co = coroutine_create(function(...)
-			f(...)
-			while true do
-				local session = session_coroutine_id[co]
-				if session and session ~= 0 then
-					local source = debug.getinfo(f,"S")
-					skynet.error(string.format("Maybe forgot response session %s from %s : %s:%d",
-						session,
-						skynet.address(session_coroutine_address[co]),
-						source.source, source.linedefined))
-				end
-				-- coroutine exit
-				local tag = session_coroutine_tracetag[co]
-				if tag ~= nil then
-					if tag then c.trace(tag, "end")	end
-					session_coroutine_tracetag[co] = nil
-				end
-				local address = session_coroutine_address[co]
-				if address then
-					session_coroutine_id[co] = nil
-					session_coroutine_address[co] = nil
-				end
-
-				-- recycle co into pool
-				f = nil
-				coroutine_pool[#coroutine_pool+1] = co
-				-- recv new main function f
-				f = coroutine_yield "SUSPEND"
-				f(coroutine_yield())
-			end
-		end)
+		coroutine_pool_miss = coroutine_pool_miss + 1
+		co = co_new(f)
 	else
+		coroutine_pool_hit = coroutine_pool_hit + 1
 		-- pass the main function f to coroutine, and restore running thread
 		local running = running_thread
 		coroutine_resume(co, f)
@@ -411,6 +492,37 @@ local function co_create(f)
 	return co
 end
 
+local function co_prewarm()
+	local running = running_thread
+	local nop = function() end
+	for i = #coroutine_pool + 1, coroutine_pool_min do
+		-- run nop and recycle into pool
+		coroutine_resume(co_new(nop))
+	end
+	running_thread = running
+end
+
+-- set min/max of the coroutine pool, or get the pool stat without arguments
+function skynet.coroutine_pool(min, max)
+	if min == nil and max == nil then
+		return {
+			size = #coroutine_pool,
+			min = coroutine_pool_min,
+			max = coroutine_pool_max,
+			hit = coroutine_pool_hit,
+			miss = coroutine_pool_miss,
+		}
+	end
+	coroutine_pool_min = min or coroutine_pool_min
+	coroutine_pool_max = max or coroutine_pool_max
+	assert(coroutine_pool_min <= coroutine_pool_max)
+	for i = #coroutine_pool, coroutine_pool_max + 1, -1 do
+		coroutine.close(coroutine_pool[i])
+		coroutine_pool[i] = nil
+	end
+	co_prewarm()
+end
+
 local function dispatch_wakeup()
 	while true do
 		local token = tremove(wakeup_queue,1)
@@ -440,7 +552,7 @@ function suspend(co, result, command)
 				-- only call response error
 				local tag = session_coroutine_tracetag[co]
 				if tag then c.trace(tag, "error") end
-				c.send(addr, skynet.PTYPE_ERROR, session, "")
+				response_send(addr, skynet.PTYPE_ERROR, session, "")
 			end
 			session_coroutine_id[co] = nil
 		end
@@ -540,13 +652,17 @@ function skynet.wait(token)
 	session_id_coroutine[session] = nil
 end
 
+local gather_break	-- see skynet.callall
+
 function skynet.killthread(thread)
 	local session
 	-- find session
 	if type(thread) == "string" then
 		for k,v in pairs(session_id_coroutine) do
-			local thread_string = tostring(v)
-			if thread_string:find(thread) then
+			if type(v) == "table" then
+				v = v.co	-- skynet.callall
+			end
+			if type(v) == "thread" and tostring(v):find(thread) then
 				session = k
 				break
 			end
@@ -562,7 +678,7 @@ function skynet.killthread(thread)
 			end
 		end
 		for k,v in pairs(session_id_coroutine) do
-			if v == thread then
+			if v == thread or (type(v) == "table" and v.co == thread) then
 				session = k
 				break
 			end
@@ -572,17 +688,27 @@ function skynet.killthread(thread)
 	if co == nil then
 		return
 	end
+	local gather = type(co) == "table"
+	if gather then
+		-- break all the sessions of skynet.callall
+		co = gather_break(co)
+		if co == nil then
+			return
+		end
+	end
 	local addr = session_coroutine_address[co]
 	if addr then
 		session_coroutine_address[co] = nil
 		session_coroutine_tracetag[co] = nil
 		local session = session_coroutine_id[co]
 		if session > 0 then
-			c.send(addr, skynet.PTYPE_ERROR, session, "")
+			response_send(addr, skynet.PTYPE_ERROR, session, "")
 		end
 		session_coroutine_id[co] = nil
 	end
-	if watching_session[session] then
+	if gather then
+		-- gather_break has done
+	elseif watching_session[session] then
 		session_id_coroutine[session] = "BREAK"
 		watching_session[session] = nil
 	else
@@ -651,10 +777,13 @@ function skynet.exit()
 	for co, session in pairs(session_coroutine_id) do
 		local address = session_coroutine_address[co]
 		if session~=0 and address then
-			c.send(address, skynet.PTYPE_ERROR, session, "")
+			response_send(address, skynet.PTYPE_ERROR, session, "")
 		end
 	end
 	for session, co in pairs(session_id_coroutine) do
+		if type(co) == "table" then
+			co = gather_break(co)	-- skynet.callall
+		end
 		if type(co) == "thread" and co ~= running_thread then
 			coroutine.close(co)
 		end
@@ -706,7 +835,10 @@ skynet.redirect = function(dest,source,typename,...)
 end
 
 skynet.pack = assert(c.pack)
+skynet.packhint = assert(c.packhint)	-- packhint(sz, ...)
+skynet.packestimate = assert(c.packestimate)
 skynet.packstring = assert(c.packstring)
+skynet.sharedpack = assert(c.sharedpack)	-- use skynet.rawsend(addr, typename, obj) to send it
 skynet.unpack = assert(c.unpack)
 skynet.tostring = assert(c.tostring)
 skynet.trash = assert(c.trash)
@@ -748,6 +880,121 @@ function skynet.rawcall(addr, typename, msg, sz)
 	return yield_call(addr, session)
 end
 
+-- requests is an array of argument lists, the callee dispatches each of them as a request of typename.
+-- returns an array of results, tpack(...) for each succeeded request and false for each failed one.
+function skynet.callbatch(addr, typename, requests)
+	local tag = session_coroutine_tracetag[running_thread]
+	if tag then
+		c.trace(tag, "call", 2)
+		c.send(addr, skynet.PTYPE_TRACE, 0, tag)
+	end
+	local p = proto[typename]
+	local items = {}
+	for i = 1, #requests do
+		local req = requests[i]
+		items[i] = msg_tostring(p.pack(tunpack(req, 1, req.n)))
+	end
+	local session = auxsend(addr, skynet.PTYPE_BATCH, c.pack(p.id, items))
+	if session == nil then
+		error("call to invalid address " .. skynet.address(addr))
+	end
+	local resp = c.unpack(yield_call(addr, session))
+	for i = 1, #items do
+		local r = resp[i]
+		if r then
+			resp[i] = tpack(p.unpack(r, #r))
+		end
+	end
+	return resp
+end
+
+do ---- scatter/gather, see skynet.callall
+	local gather_meta = {}	; gather_meta.__index = gather_meta
+
+	-- the sessions left are broken, returns the caller (nil if it has been returned)
+	function gather_break(self)
+		for session in pairs(self.sessions) do
+			session_id_coroutine[session] = "BREAK"
+			watching_session[session] = nil
+		end
+		self.sessions = {}
+		if self.timeout then
+			session_id_coroutine[self.timeout] = "BREAK"
+			self.timeout = nil
+		end
+		local co = self.co
+		self.co = nil
+		return co
+	end
+
+	local function gather_done(self)
+		local co = gather_break(self)
+		return suspend(co, coroutine_resume(co))
+	end
+
+	-- responses are copied into the native buffer, the caller is resumed only once
+	function gather_meta:response(session, succ, msg, sz)
+		if session == self.timeout then
+			self.timeout = nil
+			self.timedout = true
+			return gather_done(self)
+		end
+		local index = self.sessions[session]
+		self.sessions[session] = nil
+		watching_session[session] = nil
+		local pending
+		if succ then
+			pending = self.gather:put(index, msg, sz)
+		else
+			pending = self.gather:fail(index)
+		end
+		if pending == 0 then
+			return gather_done(self)
+		end
+	end
+
+	-- send the same request to every address in addrs, and wait for all the responses or timeout (in 1/100s, nil for no timeout).
+	-- returns an array for addrs : tpack(...) for succeeded, false for failed and nil for no response, and true when timeout
+	function skynet.callall(addrs, timeout, typename, ...)
+		local p = proto[typename]
+		local n = #addrs
+		local msg = msg_tostring(p.pack(...))
+		local g = c.gather(n)
+		local self = setmetatable({ gather = g, sessions = {} }, gather_meta)
+		local sessions = self.sessions
+		local pending = n
+		for i = 1, n do
+			local addr = addrs[i]
+			local session = auxsend(addr, p.id, msg)
+			if session == nil then
+				pending = g:fail(i)
+			else
+				sessions[session] = i
+				watching_session[session] = addr
+				session_id_coroutine[session] = self
+			end
+		end
+		if pending > 0 then
+			if timeout then
+				self.timeout = auxtimeout(timeout)
+				session_id_coroutine[self.timeout] = self
+			end
+			self.co = running_thread
+			coroutine_yield "SUSPEND"
+		end
+		local resp = {}
+		for i = 1, n do
+			local msg, sz = g:get(i)
+			if msg then
+				resp[i] = tpack(p.unpack(msg, sz))
+			else
+				resp[i] = msg
+			end
+		end
+		return resp, self.timedout
+	end
+end
+
 function skynet.tracecall(tag, addr, typename, msg, sz)
 	c.trace(tag, "tracecall begin")
 	c.send(addr, skynet.PTYPE_TRACE, 0, tag)
@@ -774,12 +1021,12 @@ function skynet.ret(msg, sz)
 		return false	-- send don't need ret
 	end
 	local co_address = session_coroutine_address[running_thread]
-	local ret = c.send(co_address, skynet.PTYPE_RESPONSE, co_session, msg, sz)
+	local ret = response_send(co_address, skynet.PTYPE_RESPONSE, co_session, msg, sz)
 	if ret then
 		return true
 	elseif ret == false then
 		-- If the package is too large, returns false. so we should report error back
-		c.send(co_address, skynet.PTYPE_ERROR, co_session, "")
+		response_send(co_address, skynet.PTYPE_ERROR, co_session, "")
 	end
 	return false
 end
@@ -787,7 +1034,7 @@ end
 function skynet.context()
 	local co_session = session_coroutine_id[running_thread]
 	local co_address = session_coroutine_address[running_thread]
-	return co_session, co_address
+	return co_session, response_source(co_address)
 end
 
 function skynet.ignoreret()
@@ -816,13 +1063,13 @@ function skynet.response(pack)
 		local ret
 		if unresponse[response] then
 			if ok then
-				ret = c.send(co_address, skynet.PTYPE_RESPONSE, co_session, pack(...))
+				ret = response_send(co_address, skynet.PTYPE_RESPONSE, co_session, pack(...))
 				if ret == false then
 					-- If the package is too large, returns false. so we should report error back
-					c.send(co_address, skynet.PTYPE_ERROR, co_session, "")
+					response_send(co_address, skynet.PTYPE_ERROR, co_session, "")
 				end
 			else
-				ret = c.send(co_address, skynet.PTYPE_ERROR, co_session, "")
+				ret = response_send(co_address, skynet.PTYPE_ERROR, co_session, "")
 			end
 			unresponse[response] = nil
 			ret = ret ~= nil
@@ -832,7 +1079,7 @@ function skynet.response(pack)
 		pack = nil
 		return ret
 	end
-	unresponse[response] = co_address
+	unresponse[response] = response_source(co_address)
 
 	return response
 end
@@ -898,6 +1145,59 @@ end
 
 local trace_source = {}
 
+local function batch_resume(f, co_session, address, tag, source, ...)
+	local co = co_create(f)
+	session_coroutine_id[co] = co_session
+	session_coroutine_address[co] = address
+	session_coroutine_tracetag[co] = tag
+	return suspend(co, coroutine_resume(co, co_session, source, ...))
+end
+
+-- unpack the item in the protected call, before the coroutine is created
+local function batch_item(f, co_session, address, tag, source, unpack, item)
+	return batch_resume(f, co_session, address, tag, source, unpack(item, #item))
+end
+
+local function dispatch_batch(msg, sz, session, source)
+	local tag = trace_source[source]
+	trace_source[source] = nil
+	local id, items = c.unpack(msg, sz)
+	local p = proto[id]
+	local f = p and p.dispatch
+	if f == nil then
+		if session ~= 0 then
+			c.send(source, skynet.PTYPE_ERROR, session, "")
+		else
+			unknown_request(session, source, msg, sz, skynet.PTYPE_BATCH)
+		end
+		return
+	end
+	local n = #items
+	local address = source
+	if session ~= 0 then
+		address = new_batch(source, session, n)
+	end
+	if tag then
+		c.trace(tag, "request")
+	end
+	local err
+	for i = 1, n do
+		local co_session = session ~= 0 and i or 0
+		-- every item should run, even if some of them fail
+		local ok, e = pcall(batch_item, f, co_session, address, tag, source, p.unpack, items[i])
+		if not ok then
+			if session ~= 0 then
+				-- a malformed item has no coroutine to respond, it's ignored if the item has responded
+				address:reply(i, skynet.PTYPE_ERROR)
+			end
+			err = err and (err .. "\n" .. tostring(e)) or tostring(e)
+		end
+	end
+	if err then
+		error(err)
+	end
+end
+
 local function raw_dispatch_message(prototype, msg, sz, session, source)
 	-- skynet.PTYPE_RESPONSE = 1, read skynet.h
 	if prototype == 1 then
@@ -906,12 +1206,17 @@ local function raw_dispatch_message(prototype, msg, sz, session, source)
 			session_id_coroutine[session] = nil
 		elseif co == nil then
 			unknown_response(session, source, msg, sz)
+		elseif type(co) == "table" then
+			session_id_coroutine[session] = nil
+			co:response(session, true, msg, sz)
 		else
 			local tag = session_coroutine_tracetag[co]
 			if tag then c.trace(tag, "resume") end
 			session_id_coroutine[session] = nil
 			suspend(co, coroutine_resume(co, true, msg, sz, session))
 		end
+	elseif prototype == skynet.PTYPE_BATCH then
+		dispatch_batch(msg, sz, session, source)
 	else
 		local p = proto[prototype]
 		if p == nil then
@@ -1076,6 +1381,7 @@ end
 
 function skynet.start(start_func)
 	c.callback(skynet.dispatch_message)
+	co_prewarm()
 	init_thread = skynet.timeout(0, function()
 		skynet.init_service(start_func)
 		init_thread = nil
@@ -1097,6 +1403,9 @@ end
 local function task_traceback(co)
 	if co == "BREAK" then
 		return co
+	elseif type(co) == "table" then
+		-- skynet.callall
+		return co.co and traceback(co.co) or "GATHER"
 	elseif timeout_traceback and timeout_traceback[co] then
 		return timeout_traceback[co]
 	else
@@ -1178,6 +1487,12 @@ function skynet.memlimit(bytes)
 	skynet.memlimit = nil	-- set only once
 end
 
+-- run gc steps between dispatch batches instead of in message handlers, see service_snlua.c
+function skynet.gcidle(pause, stepmul, stepsize)
+	debug.getregistry().gcidle = { pause = pause, stepmul = stepmul, stepsize = stepsize }
+	skynet.gcidle = nil	-- set only once
+end
+
 -- Inject internal debug framework
 local debug = require "skynet.debug"
 debug.init(skynet, {
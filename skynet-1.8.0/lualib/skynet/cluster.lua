@@ -3,6 +3,7 @@ local skynet = require "skynet"
 local clusterd
 local cluster = {}
 local sender = {}
+local sender_lanes = {}	-- node -> lanes, only for the node with more than one connection, see clusterd.lua
 local task_queue = {}
 
 local function repack(address, ...)
@@ -10,10 +11,19 @@ local function repack(address, ...)
 end
 
 local function request_sender(q, node)
-	local ok, c = pcall(skynet.call, clusterd, "lua", "sender", node)
+	local ok, lanes = pcall(skynet.call, clusterd, "lua", "lanes", node)
+	local c
 	if not ok then
-		skynet.error(c)
-		c = nil
+		skynet.error(lanes)
+	elseif lanes then
+		c = lanes[1]
+		if #lanes > 1 or lanes.large then
+			lanes.load = {}
+			for i = 1, #lanes do
+				lanes.load[i] = 0
+			end
+			sender_lanes[node] = lanes
+		end
 	end
 	-- run tasks in queue
 	local confirm = coroutine.running()
@@ -57,6 +67,32 @@ end
 
 cluster.get_sender = get_sender
 
+local function lane_return(load, i, ok, ...)
+	load[i] = load[i] - 1
+	if not ok then
+		error((...), 0)
+	end
+	return ...
+end
+
+-- large payload goes to the dedicated lane, others go to the least loaded lane
+local function lane_call(lanes, address, msg, sz)
+	if lanes.large and sz >= lanes.largepayload then
+		return skynet.call(lanes.large, "lua", "req", address, msg, sz)
+	end
+	local load = lanes.load
+	local idx = 1
+	local min = load[1]
+	for i = 2, #load do
+		if load[i] < min then
+			idx = i
+			min = load[i]
+		end
+	end
+	load[idx] = min + 1
+	return lane_return(load, idx, pcall(skynet.call, lanes[idx], "lua", "req", address, msg, sz))
+end
+
 function cluster.call(node, address, ...)
 	-- skynet.pack(...) will free by cluster.core.packrequest
 	local s = sender[node]
@@ -64,11 +100,16 @@ function cluster.call(node, address, ...)
 		local task = skynet.packstring(address, ...)
 		return skynet.call(get_sender(node), "lua", "req", repack(skynet.unpack(task)))
 	end
+	local lanes = sender_lanes[node]
+	if lanes then
+		return lane_call(lanes, address, skynet.pack(...))
+	end
 	return skynet.call(s, "lua", "req", address, skynet.pack(...))
 end
 
 function cluster.send(node, address, ...)
 	-- push is the same with req, but no response
+	-- push always goes through the first lane to keep the order
 	local s = sender[node]
 	if not s then
 		table.insert(task_queue[node], skynet.packstring(address, ...))
@@ -89,6 +130,16 @@ function cluster.reload(config)
 	skynet.call(clusterd, "lua", "reload", config)
 end
 
+-- returns the metrics of the links to the node, or { node = stat } of all the nodes, see clustersender.lua
+function cluster.stat(node)
+	return skynet.call(clusterd, "lua", "stat", node)
+end
+
+-- returns the compression counters of the links : { node = stat }, { fd = stat }
+function cluster.compressstat()
+	return skynet.call(clusterd, "lua", "compressstat")
+end
+
 function cluster.proxy(node, name)
 	return skynet.call(clusterd, "lua", "proxy", node, name)
 end
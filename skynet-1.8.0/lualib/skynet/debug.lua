@@ -1,4 +1,5 @@
 local table = table
+local profile = require "skynet.profile"
 local extern_dbgcmd = {}
 
 local function init(skynet, export)
@@ -41,6 +42,13 @@ local function init(skynet, export)
 			stat.mqlen = skynet.stat "mqlen"
 			stat.cpu = skynet.stat "cpu"
 			stat.message = skynet.stat "message"
+			local copool = skynet.coroutine_pool()
+			stat.copool = string.format("%d/%d hit %d miss %d", copool.size, copool.max, copool.hit, copool.miss)
+			local gc = profile.gcstat()
+			if gc then
+				stat.gcstep = gc.steps
+				stat.gctime = gc.time
+			end
 			skynet.ret(skynet.pack(stat))
 		end
 
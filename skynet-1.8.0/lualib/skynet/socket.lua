@@ -27,6 +27,16 @@ local function wakeup(s)
 	end
 end
 
+local function wakeup_drain(s)
+	local drain = s.drain
+	if drain then
+		s.drain = nil
+		for _, co in ipairs(drain) do
+			skynet.wakeup(co)
+		end
+	end
+end
+
 local function pause_socket(s, size)
 	if s.pause ~= nil then
 		return
@@ -125,6 +135,7 @@ socket_message[3] = function(id)
 	if s then
 		s.connected = false
 		wakeup(s)
+		wakeup_drain(s)
 	else
 		driver.close(id)
 	end
@@ -166,6 +177,7 @@ socket_message[5] = function(id, _, err)
 	driver.shutdown(id)
 
 	wakeup(s)
+	wakeup_drain(s)
 end
 
 -- SKYNET_SOCKET_TYPE_UDP = 6
@@ -198,6 +210,33 @@ socket_message[7] = function(id, size)
 	end
 end
 
+-- SKYNET_SOCKET_TYPE_UDPBATCH = 8
+socket_message[8] = function(id, count, data)
+	local s = socket_pool[id]
+	if s == nil or s.callback == nil then
+		skynet.error("socket: drop udp package from " .. id)
+		driver.drop(data, count)
+		return
+	end
+	local batch = driver.udp_unpack(data, count)
+	driver.drop(data, count)
+	local callback = s.callback
+	for i = 1, count * 2, 2 do
+		callback(batch[i], batch[i+1])
+	end
+end
+
+-- SKYNET_SOCKET_TYPE_DRAIN = 9
+socket_message[9] = function(id, size)
+	local s = socket_pool[id]
+	if s then
+		wakeup_drain(s)
+		if s.on_drain then
+			s.on_drain(id, size)
+		end
+	end
+end
+
 skynet.register_protocol {
 	name = "socket",
 	id = skynet.PTYPE_SOCKET,	-- PTYPE_SOCKET = 6
@@ -391,8 +430,10 @@ function socket.block(id)
 	return s.connected
 end
 
+-- returns ok, block. block is true when the send buffer is over the high watermark, See socket.flowcontrol
 socket.write = assert(driver.send)
 socket.lwrite = assert(driver.lsend)
+socket.broadcast = assert(driver.broadcast)
 socket.header = assert(driver.header)
 
 function socket.invalid(id)
@@ -406,12 +447,14 @@ function socket.disconnected(id)
 	end
 end
 
-function socket.listen(host, port, backlog)
+-- If reuseport is true, the socket is opened with SO_REUSEPORT,
+-- so the same port can be listened by more than one service to spread the accepting.
+function socket.listen(host, port, backlog, reuseport)
 	if port == nil then
 		host, port = string.match(host, "([^:]+):(.+)$")
 		port = tonumber(port)
 	end
-	local id = driver.listen(host, port, backlog)
+	local id = driver.listen(host, port, backlog, reuseport)
 	local s = {
 		id = id,
 		connected = false,
@@ -483,6 +526,12 @@ function socket.udp_dial(addr, port, callback)
 	return id
 end
 
+-- Read up to 16 datagrams by one syscall and forward them as one SKYNET_SOCKET_TYPE_UDPBATCH message.
+-- Only the udp sockets set here receive it, the callback is still called once per datagram. enable is true by default.
+function socket.udp_batch(id, enable)
+	driver.udp_batch(id, enable)
+end
+
 socket.sendto = assert(driver.udp_send)
 socket.udp_address = assert(driver.udp_address)
 socket.netstat = assert(driver.info)
@@ -494,6 +543,39 @@ function socket.warning(id, callback)
 	obj.on_warning = callback
 end
 
+-- When the send buffer reaches high bytes, socket.write returns (true, true) until it drains to low bytes (high/2 by default).
+-- If droplow is true, the packages of socket.lwrite are dropped over high. high = 0 : disable.
+function socket.flowcontrol(id, high, low, droplow)
+	driver.flowcontrol(id, high, low, droplow)
+end
+
+-- Wait until the send buffer drains to the low watermark, returns false if the socket is closed.
+-- It returns at once if the socket is not blocked (SOCKET_DRAIN comes only after the socket is blocked).
+function socket.drain(id)
+	local s = socket_pool[id]
+	if not s or not s.connected then
+		return false
+	end
+	if not driver.blocked(id) then
+		return true
+	end
+	local co = coroutine.running()
+	local drain = s.drain
+	if drain then
+		table.insert(drain, co)
+	else
+		s.drain = { co }
+	end
+	skynet.wait(co)
+	return s.connected
+end
+
+function socket.ondrain(id, callback)
+	local obj = socket_pool[id]
+	assert(obj)
+	obj.on_drain = callback
+end
+
 function socket.onclose(id, callback)
 	socket_onclose[id] = callback
 end
@@ -537,8 +537,8 @@ function channel:request(request, response, padding)
 	return wait_for_response(self, response)
 end
 
-function channel:response(response)
-	assert(block_connect(self))
+function channel:response(response, once)
+	assert(block_connect(self, once))
 
 	return wait_for_response(self, response)
 end
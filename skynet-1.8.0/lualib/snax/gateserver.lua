@@ -26,10 +26,26 @@ function gateserver.closeclient(fd)
 	local c = connection[fd]
 	if c ~= nil then
 		connection[fd] = nil
+		if queue then
+			netpack.route(queue, fd)
+		end
 		socketdriver.close(fd)
 	end
 end
 
+-- The packages of fd are sent to handle (PTYPE_CLIENT, session is fd) in C, handler.message will not be called.
+-- The packages of fd still in the queue are sent to handle first, so handle gets them in order,
+-- unless handler.message is blocked (forked) with an earlier one.
+-- If the header has an id field (conf.header), the id field is sent before the payload.
+-- handle = nil : remove the route
+function gateserver.route(fd, handle, source)
+	if handle then
+		queue = netpack.route(queue, fd, handle, source)
+	elseif queue then
+		netpack.route(queue, fd)
+	end
+end
+
 function gateserver.start(handler)
 	assert(handler.message)
 	assert(handler.connect)
@@ -42,8 +58,12 @@ function gateserver.start(handler)
 		local port = assert(conf.port)
 		maxclient = conf.maxclient or 1024
 		nodelay = conf.nodelay
+		if conf.header then
+			-- See skynet-src/frame_format.h, handler.message(fd, msg, sz, id) gets the id of header
+			queue = netpack.format(queue, conf.header)
+		end
 		skynet.error(string.format("Listen on %s:%d", address, port))
-		socket = socketdriver.listen(address, port, conf.backlog)
+		socket = socketdriver.listen(address, port, conf.backlog, conf.reuseport)
 		listen_context.co = coroutine.running()
 		listen_context.fd = socket
 		skynet.wait(listen_context.co)
@@ -63,9 +83,9 @@ function gateserver.start(handler)
 
 	local MSG = {}
 
-	local function dispatch_msg(fd, msg, sz)
+	local function dispatch_msg(fd, msg, sz, id)
 		if connection[fd] then
-			handler.message(fd, msg, sz)
+			handler.message(fd, msg, sz, id)
 		else
 			skynet.error(string.format("Drop message from fd (%d) : %s", fd, netpack.tostring(msg,sz)))
 		end
@@ -74,15 +94,15 @@ function gateserver.start(handler)
 	MSG.data = dispatch_msg
 
 	local function dispatch_queue()
-		local fd, msg, sz = netpack.pop(queue)
+		local fd, msg, sz, id = netpack.pop(queue)
 		if fd then
 			-- may dispatch even the handler.message blocked
 			-- If the handler.message never block, the queue should be empty, so only fork once and then exit.
 			skynet.fork(dispatch_queue)
-			dispatch_msg(fd, msg, sz)
+			dispatch_msg(fd, msg, sz, id)
 
-			for fd, msg, sz in netpack.pop, queue do
-				dispatch_msg(fd, msg, sz)
+			for fd, msg, sz, id in netpack.pop, queue do
+				dispatch_msg(fd, msg, sz, id)
 			end
 		end
 	end
@@ -133,6 +153,13 @@ function gateserver.start(handler)
 		end
 	end
 
+	-- the send buffer drains to the low watermark, See socketdriver.flowcontrol
+	function MSG.drain(fd, size)
+		if handler.drain then
+			handler.drain(fd, size)
+		end
+	end
+
 	function MSG.init(id, addr, port)
 		if listen_context then
 			local co = listen_context.co
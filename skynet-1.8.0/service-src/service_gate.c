@@ -1,7 +1,7 @@
 #include "skynet.h"
 #include "skynet_socket.h"
-#include "databuffer.h"
-#include "hashid.h"
+#include "socket_server.h"
+#include "frame_format.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -9,15 +9,24 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdbool.h>
 
 #define BACKLOG 128
+#define MAX_PACKAGE 0x1000000
+#define READ_BUFFER_SIZE 0x1000
+
+// the live sockets never share a slot, See MAX_SOCKET in socket_server.h
+#define SOCKET_SLOT(id) (((unsigned)id) % MAX_SOCKET)
 
 struct connection {
 	int id;	// skynet_socket id
 	uint32_t agent;
 	uint32_t client;
 	char remote_name[32];
-	struct databuffer buffer;
+	// the head of an incomplete frame, the complete frames are parsed in place and never stay here
+	char * rbuffer;
+	int rsize;
+	int rcap;
 };
 
 struct gate {
@@ -26,12 +35,13 @@ struct gate {
 	uint32_t watchdog;
 	uint32_t broker;
 	int client_tag;
-	int header_size;
+	struct frame_format format;	// See frame_format.h, the id field is forwarded with the payload
+	bool batch;	// forward all the complete frames of one read in a message
 	int max_connection;
-	struct hashid hash;
+	int free_n;
+	int *free_conn;	// the free index of conn
+	int *slot;	// socket slot -> index of conn + 1
 	struct connection *conn;
-	// todo: save message pool ptr for release
-	struct messagepool mp;
 };
 
 struct gate *
@@ -55,12 +65,46 @@ gate_release(struct gate *g) {
 	if (g->listen_id >= 0) {
 		skynet_socket_close(ctx, g->listen_id);
 	}
-	messagepool_free(&g->mp);
-	hashid_clear(&g->hash);
+	if (g->conn) {
+		for (i=0;i<g->max_connection;i++) {
+			skynet_free(g->conn[i].rbuffer);
+		}
+	}
+	skynet_free(g->free_conn);
+	skynet_free(g->slot);
 	skynet_free(g->conn);
 	skynet_free(g);
 }
 
+static int
+conn_lookup(struct gate *g, int id) {
+	if (g->slot == NULL)
+		return -1;
+	int index = g->slot[SOCKET_SLOT(id)] - 1;
+	if (index >= 0 && g->conn[index].id == id) {
+		return index;
+	}
+	return -1;
+}
+
+static int
+conn_insert(struct gate *g, int id) {
+	assert(g->free_n > 0);
+	int index = g->free_conn[--g->free_n];
+	g->slot[SOCKET_SLOT(id)] = index + 1;
+	return index;
+}
+
+static int
+conn_remove(struct gate *g, int id) {
+	int index = conn_lookup(g, id);
+	if (index >= 0) {
+		g->slot[SOCKET_SLOT(id)] = 0;
+		g->free_conn[g->free_n++] = index;
+	}
+	return index;
+}
+
 static void
 _parm(char *msg, int sz, int command_sz) {
 	while (command_sz < sz) {
@@ -77,7 +121,7 @@ _parm(char *msg, int sz, int command_sz) {
 
 static void
 _forward_agent(struct gate * g, int fd, uint32_t agentaddr, uint32_t clientaddr) {
-	int id = hashid_lookup(&g->hash, fd);
+	int id = conn_lookup(g, fd);
 	if (id >=0) {
 		struct connection * agent = &g->conn[id];
 		agent->agent = agentaddr;
@@ -103,7 +147,7 @@ _ctrl(struct gate * g, const void * msg, int sz) {
 	if (memcmp(command,"kick",i)==0) {
 		_parm(tmp, sz, i);
 		int uid = strtol(command , NULL, 10);
-		int id = hashid_lookup(&g->hash, uid);
+		int id = conn_lookup(g, uid);
 		if (id>=0) {
 			skynet_socket_close(ctx, uid);
 		}
@@ -134,7 +178,7 @@ _ctrl(struct gate * g, const void * msg, int sz) {
 	if (memcmp(command,"start",i) == 0) {
 		_parm(tmp, sz, i);
 		int uid = strtol(command , NULL, 10);
-		int id = hashid_lookup(&g->hash, uid);
+		int id = conn_lookup(g, uid);
 		if (id>=0) {
 			skynet_socket_start(ctx, uid);
 		}
@@ -165,52 +209,177 @@ _report(struct gate * g, const char * data, ...) {
 	skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT,  0, tmp, n);
 }
 
+/*
+	msg is forwarded to the broker or the agent, and it's owned by the receiver.
+	In batch mode, msg is the frames with their headers, as they are on the wire.
+ */
 static void
-_forward(struct gate *g, struct connection * c, int size) {
+_forward(struct gate *g, struct connection * c, void * msg, int size) {
 	struct skynet_context * ctx = g->ctx;
 	int fd = c->id;
 	if (fd <= 0) {
 		// socket error
+		skynet_free(msg);
 		return;
 	}
 	if (g->broker) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,(char *)temp, size);
-		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, fd, temp, size);
+		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, fd, msg, size);
 		return;
 	}
 	if (c->agent) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,(char *)temp, size);
-		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, fd , temp, size);
+		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, fd , msg, size);
 	} else if (g->watchdog) {
 		char * tmp = skynet_malloc(size + 32);
 		int n = snprintf(tmp,32,"%d data ",c->id);
-		databuffer_read(&c->buffer,&g->mp,tmp+n,size);
+		memcpy(tmp+n, msg, size);
+		skynet_free(msg);
 		skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT | PTYPE_TAG_DONTCOPY, fd, tmp, size + n);
+	} else {
+		skynet_free(msg);
 	}
 }
 
+static void
+read_append(struct connection *c, const char * data, int sz) {
+	int need = c->rsize + sz;
+	if (need > c->rcap) {
+		int cap = c->rcap ? c->rcap : READ_BUFFER_SIZE;
+		while (cap < need) {
+			cap *= 2;
+		}
+		c->rbuffer = skynet_realloc(c->rbuffer, cap);
+		c->rcap = cap;
+	}
+	memcpy(c->rbuffer + c->rsize, data, sz);
+	c->rsize = need;
+}
+
+static void
+read_clear(struct connection *c) {
+	skynet_free(c->rbuffer);
+	c->rbuffer = NULL;
+	c->rsize = 0;
+	c->rcap = 0;
+}
+
+static void
+close_invalid(struct gate *g, struct connection *c, int id) {
+	struct skynet_context * ctx = g->ctx;
+	read_clear(c);
+	skynet_socket_close(ctx, id);
+	skynet_error(ctx, "Recv invalid socket message (or > 16M) from %d", id);
+}
+
+// returns the header size of the frame, 0 if it's incomplete, -1 if it's invalid or too large
+static inline int
+read_header(struct gate *g, const char * buf, int sz, uint32_t *len) {
+	int hs = frame_length(&g->format, (const uint8_t *)buf, sz, len);
+	if (hs > 0 && *len >= MAX_PACKAGE)
+		return -1;
+	return hs;
+}
+
+// returns the bytes of the frame in rbuffer, 0 if it's incomplete, -1 if it's invalid
+static int
+pending_frame(struct gate *g, struct connection *c, int *need, int *hs) {
+	uint32_t len;
+	*hs = read_header(g, c->rbuffer, c->rsize, &len);
+	if (*hs < 0)
+		return -1;
+	if (*hs == 0) {
+		// read the header byte by byte, it may be a varint
+		*need = c->rsize + 1;
+		return 0;
+	}
+	*need = *hs + len;
+	return c->rsize == *need ? *need : 0;
+}
+
+static void
+forward_copy(struct gate *g, struct connection *c, const char * data, int sz) {
+	void * msg = skynet_malloc(sz);
+	memcpy(msg, data, sz);
+	_forward(g, c, msg, sz);
+}
+
 static void
 dispatch_message(struct gate *g, struct connection *c, int id, void * data, int sz) {
-	databuffer_push(&c->buffer,&g->mp, data, sz);
-	for (;;) {
-		int size = databuffer_readheader(&c->buffer, &g->mp, g->header_size);
-		if (size < 0) {
+	bool batch = g->batch && (g->broker || c->agent);
+	char * ptr = data;
+	int hs;
+	// complete the frame left by the last read
+	while (c->rsize > 0 && sz > 0) {
+		int need;
+		int n = pending_frame(g, c, &need, &hs);
+		if (n < 0) {
+			close_invalid(g, c, id);
+			skynet_free(data);
+			return;
+		}
+		int s = need - c->rsize;
+		if (s > sz)
+			s = sz;
+		read_append(c, ptr, s);
+		ptr += s;
+		sz -= s;
+		n = pending_frame(g, c, &need, &hs);
+		if (n < 0) {
+			close_invalid(g, c, id);
+			skynet_free(data);
 			return;
-		} else if (size > 0) {
-			if (size >= 0x1000000) {
-				struct skynet_context * ctx = g->ctx;
-				databuffer_clear(&c->buffer,&g->mp);
-				skynet_socket_close(ctx, id);
-				skynet_error(ctx, "Recv socket message > 16M");
+		}
+		if (n > 0) {
+			if (batch) {
+				forward_copy(g, c, c->rbuffer, n);
+			} else if (n > hs) {
+				// the empty frame is dropped
+				forward_copy(g, c, c->rbuffer + hs, n - hs);
+			}
+			c->rsize = 0;
+		}
+	}
+	// parse the frames in the socket buffer
+	int offset = 0;
+	while (offset < sz) {
+		uint32_t len;
+		hs = read_header(g, ptr + offset, sz - offset, &len);
+		if (hs == 0)
+			break;
+		if (hs < 0) {
+			close_invalid(g, c, id);
+			skynet_free(data);
+			return;
+		}
+		if (sz - offset - hs < (int)len)
+			break;
+		if (!batch && len > 0) {
+			char * frame = ptr + offset + hs;
+			if (offset + hs + (int)len == sz) {
+				// the last frame, forward the socket buffer itself
+				memmove(data, frame, len);
+				_forward(g, c, data, len);
 				return;
-			} else {
-				_forward(g, c, size);
-				databuffer_reset(&c->buffer);
 			}
+			forward_copy(g, c, frame, len);
+		}
+		offset += hs + len;
+	}
+	if (batch && offset > 0) {
+		if (offset == sz) {
+			memmove(data, ptr, sz);
+			_forward(g, c, data, sz);
+			return;
 		}
+		forward_copy(g, c, ptr, offset);
 	}
+	if (offset < sz) {
+		read_append(c, ptr + offset, sz - offset);
+		uint32_t len;
+		if (read_header(g, c->rbuffer, c->rsize, &len) < 0) {
+			close_invalid(g, c, id);
+		}
+	}
+	skynet_free(data);
 }
 
 static void
@@ -218,7 +387,7 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 	struct skynet_context * ctx = g->ctx;
 	switch(message->type) {
 	case SKYNET_SOCKET_TYPE_DATA: {
-		int id = hashid_lookup(&g->hash, message->id);
+		int id = conn_lookup(g, message->id);
 		if (id>=0) {
 			struct connection *c = &g->conn[id];
 			dispatch_message(g, c, message->id, message->buffer, message->ud);
@@ -234,7 +403,7 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 			// start listening
 			break;
 		}
-		int id = hashid_lookup(&g->hash, message->id);
+		int id = conn_lookup(g, message->id);
 		if (id<0) {
 			skynet_error(ctx, "Close unknown connection %d", message->id);
 			skynet_socket_close(ctx, message->id);
@@ -243,10 +412,10 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 	}
 	case SKYNET_SOCKET_TYPE_CLOSE:
 	case SKYNET_SOCKET_TYPE_ERROR: {
-		int id = hashid_remove(&g->hash, message->id);
+		int id = conn_remove(g, message->id);
 		if (id>=0) {
 			struct connection *c = &g->conn[id];
-			databuffer_clear(&c->buffer,&g->mp);
+			read_clear(c);
 			memset(c, 0, sizeof(*c));
 			c->id = -1;
 			_report(g, "%d close", message->id);
@@ -256,10 +425,10 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 	case SKYNET_SOCKET_TYPE_ACCEPT:
 		// report accept, then it will be get a SKYNET_SOCKET_TYPE_CONNECT message
 		assert(g->listen_id == message->id);
-		if (hashid_full(&g->hash)) {
+		if (g->free_n == 0) {
 			skynet_socket_close(ctx, message->ud);
 		} else {
-			struct connection *c = &g->conn[hashid_insert(&g->hash, message->ud)];
+			struct connection *c = &g->conn[conn_insert(g, message->ud)];
 			if (sz >= sizeof(c->remote_name)) {
 				sz = sizeof(c->remote_name) - 1;
 			}
@@ -291,7 +460,7 @@ _cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t sour
 		// The last 4 bytes in msg are the id of socket, write following bytes to it
 		const uint8_t * idbuf = msg + sz - 4;
 		uint32_t uid = idbuf[0] | idbuf[1] << 8 | idbuf[2] << 16 | idbuf[3] << 24;
-		int id = hashid_lookup(&g->hash, uid);
+		int id = conn_lookup(g, uid);
 		if (id>=0) {
 			// don't send id (last 4 bytes)
 			skynet_socket_send(ctx, uid, (void*)msg, sz-4);
@@ -347,19 +516,29 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 	int sz = strlen(parm)+1;
 	char watchdog[sz];
 	char binding[sz];
+	char option[sz];
+	option[0] = '\0';
 	int client_tag = 0;
-	char header;
-	int n = sscanf(parm, "%c %s %s %d %d", &header, watchdog, binding, &client_tag, &max);
+	char header[sz];
+	int n = sscanf(parm, "%s %s %s %d %d %s", header, watchdog, binding, &client_tag, &max, option);
 	if (n<4) {
 		skynet_error(ctx, "Invalid gate parm %s",parm);
 		return 1;
 	}
-	if (max <=0 ) {
-		skynet_error(ctx, "Need max connection");
+	if (max <=0 || max > MAX_SOCKET) {
+		skynet_error(ctx, "Need max connection (1 - %d)", MAX_SOCKET);
 		return 1;
 	}
-	if (header != 'S' && header !='L') {
-		skynet_error(ctx, "Invalid data header style");
+	if (n == 6) {
+		if (strcmp(option, "batch") == 0) {
+			g->batch = true;
+		} else {
+			skynet_error(ctx, "Invalid gate option %s", option);
+			return 1;
+		}
+	}
+	if (frame_format_parse(&g->format, header)) {
+		skynet_error(ctx, "Invalid data header style %s", header);
 		return 1;
 	}
 
@@ -378,17 +557,21 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 
 	g->ctx = ctx;
 
-	hashid_init(&g->hash, max);
 	g->conn = skynet_malloc(max * sizeof(struct connection));
 	memset(g->conn, 0, max *sizeof(struct connection));
 	g->max_connection = max;
+	g->slot = skynet_malloc(MAX_SOCKET * sizeof(int));
+	memset(g->slot, 0, MAX_SOCKET * sizeof(int));
+	g->free_conn = skynet_malloc(max * sizeof(int));
+	g->free_n = max;
 	int i;
 	for (i=0;i<max;i++) {
 		g->conn[i].id = -1;
+		// the lower index is used first
+		g->free_conn[i] = max - 1 - i;
 	}
 	
 	g->client_tag = client_tag;
-	g->header_size = header=='S' ? 2 : 4;
 
 	skynet_callback(ctx,g,_cb);
 
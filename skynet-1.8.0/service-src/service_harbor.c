@@ -24,6 +24,11 @@
 #define HASH_SIZE 4096
 #define DEFAULT_QUEUE_SIZE 1024
 
+// the outbound frames to a remote harbor are written into its buffer, and sent once per dispatch round (see harbor_idle)
+#define WRITE_BUFFER_SIZE 0x4000
+#define WRITE_BUFFER_FLUSH 0x10000
+#define WRITE_BUFFER_ROUNDS 8	// flush even if the message queue is not empty, to bound the latency
+
 // 12 is sizeof(struct remote_message_header)
 #define HEADER_COOKIE_LENGTH 12
 
@@ -76,6 +81,10 @@ struct slave {
 	int read;
 	uint8_t size[4];
 	char * recv_buffer;
+	bool dirty;
+	size_t wsize;
+	size_t wcap;
+	uint8_t * wbuffer;
 };
 
 struct harbor {
@@ -83,6 +92,9 @@ struct harbor {
 	int id;
 	uint32_t slave;
 	struct hashmap * map;
+	int ndirty;
+	int rounds;
+	uint8_t dirty[REMOTE_MAX];	// the remote harbors have frames in the write buffer
 	struct slave s[REMOTE_MAX];
 };
 
@@ -239,6 +251,10 @@ close_harbor(struct harbor *h, int id) {
 		release_queue(s->queue);
 		s->queue = NULL;
 	}
+	skynet_free(s->wbuffer);
+	s->wbuffer = NULL;
+	s->wsize = 0;
+	s->wcap = 0;
 }
 
 static void
@@ -330,25 +346,70 @@ forward_local_messsage(struct harbor *h, void *msg, int sz) {
 }
 
 static void
-send_remote(struct skynet_context * ctx, int fd, const char * buffer, size_t sz, struct remote_message_header * cookie) {
+flush_remote(struct harbor *h, struct slave *s) {
+	if (s->wsize == 0)
+		return;
+	struct socket_sendbuffer tmp;
+	tmp.id = s->fd;
+	tmp.buffer = s->wbuffer;
+	tmp.sz = s->wsize;
+	if (s->wcap > WRITE_BUFFER_FLUSH) {
+		// grown by a large message, give it to the socket instead of copying it
+		tmp.type = SOCKET_BUFFER_MEMORY;
+		s->wbuffer = NULL;
+		s->wcap = 0;
+	} else {
+		tmp.type = SOCKET_BUFFER_RAWPOINTER;
+	}
+	s->wsize = 0;
+
+	// ignore send error, because if the connection is broken, the mainloop will recv a message.
+	skynet_socket_sendbuffer(h->ctx, &tmp);
+}
+
+static void
+flush_all(struct harbor *h) {
+	int i;
+	for (i=0;i<h->ndirty;i++) {
+		struct slave *s = &h->s[h->dirty[i]];
+		s->dirty = false;
+		if (s->fd) {
+			flush_remote(h, s);
+		}
+	}
+	h->ndirty = 0;
+	h->rounds = 0;
+}
+
+static void
+send_remote(struct harbor *h, int id, const char * buffer, size_t sz, struct remote_message_header * cookie) {
 	size_t sz_header = sz+sizeof(*cookie);
 	if (sz_header > UINT32_MAX) {
-		skynet_error(ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
+		skynet_error(h->ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
 		return;
 	}
-	uint8_t sendbuf[sz_header+4];
+	struct slave *s = &h->s[id];
+	size_t need = s->wsize + sz_header + 4;
+	if (need > s->wcap) {
+		size_t cap = s->wcap ? s->wcap : WRITE_BUFFER_SIZE;
+		while (cap < need) {
+			cap *= 2;
+		}
+		s->wbuffer = skynet_realloc(s->wbuffer, cap);
+		s->wcap = cap;
+	}
+	uint8_t * sendbuf = s->wbuffer + s->wsize;
 	to_bigendian(sendbuf, (uint32_t)sz_header);
 	memcpy(sendbuf+4, buffer, sz);
 	header_to_message(cookie, sendbuf+4+sz);
+	s->wsize = need;
 
-	struct socket_sendbuffer tmp;
-	tmp.id = fd;
-	tmp.type = SOCKET_BUFFER_RAWPOINTER;
-	tmp.buffer = sendbuf;
-	tmp.sz = sz_header+4;
-
-	// ignore send error, because if the connection is broken, the mainloop will recv a message.
-	skynet_socket_sendbuffer(ctx, &tmp);
+	if (need >= WRITE_BUFFER_FLUSH) {
+		flush_remote(h, s);
+	} else if (!s->dirty) {
+		s->dirty = true;
+		h->dirty[h->ndirty++] = id;
+	}
 }
 
 static void
@@ -391,7 +452,7 @@ dispatch_name_queue(struct harbor *h, struct keyvalue * node) {
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
 		m->header.destination |= (handle & HANDLE_MASK);
-		send_remote(context, fd, m->buffer, m->size, &m->header);
+		send_remote(h, harbor_id, m->buffer, m->size, &m->header);
 		skynet_free(m->buffer);
 	}
 }
@@ -408,14 +469,15 @@ dispatch_queue(struct harbor *h, int id) {
 
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
-		send_remote(h->ctx, fd, m->buffer, m->size, &m->header);
+		send_remote(h, id, m->buffer, m->size, &m->header);
 		skynet_free(m->buffer);
 	}
 	release_queue(queue);
 	s->queue = NULL;
 }
 
-static void
+// returns 1 if message->buffer is forwarded
+static int
 push_socket_data(struct harbor *h, const struct skynet_socket_message * message) {
 	assert(message->type == SKYNET_SOCKET_TYPE_DATA);
 	int fd = message->id;
@@ -431,10 +493,11 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 	}
 	if (s == NULL) {
 		skynet_error(h->ctx, "Invalid socket fd (%d) data", fd);
-		return;
+		return 0;
 	}
 	uint8_t * buffer = (uint8_t *)message->buffer;
 	int size = message->ud;
+	int forward = 0;
 
 	for (;;) {
 		switch(s->status) {
@@ -444,7 +507,7 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 			if (remote_id != id) {
 				skynet_error(h->ctx, "Invalid shakehand id (%d) from fd = %d , harbor = %d", id, fd, remote_id);
 				close_harbor(h,id);
-				return;
+				return 0;
 			}
 			++buffer;
 			--size;
@@ -458,12 +521,36 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 			// go though
 		}
 		case STATUS_HEADER: {
+			if (s->read == 0 && size >= 4 && buffer[0] == 0) {
+				// fast path : the whole frame is in the buffer
+				int length = buffer[1] << 16 | buffer[2] << 8 | buffer[3];
+				if (size - 4 >= length) {
+					buffer += 4;
+					size -= 4;
+					char * msg;
+					if (size == length) {
+						// the last frame, reuse the socket buffer
+						msg = message->buffer;
+						memmove(msg, buffer, length);
+						forward = 1;
+					} else {
+						msg = skynet_malloc(length);
+						memcpy(msg, buffer, length);
+					}
+					forward_local_messsage(h, msg, length);
+					buffer += length;
+					size -= length;
+					if (size == 0)
+						return forward;
+					break;
+				}
+			}
 			// big endian 4 bytes length, the first one must be 0.
 			int need = 4 - s->read;
 			if (size < need) {
 				memcpy(s->size + s->read, buffer, size);
 				s->read += size;
-				return;
+				return forward;
 			} else {
 				memcpy(s->size + s->read, buffer, need);
 				buffer += need;
@@ -472,14 +559,14 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 				if (s->size[0] != 0) {
 					skynet_error(h->ctx, "Message is too long from harbor %d", id);
 					close_harbor(h,id);
-					return;
+					return forward;
 				}
 				s->length = s->size[1] << 16 | s->size[2] << 8 | s->size[3];
 				s->read = 0;
 				s->recv_buffer = skynet_malloc(s->length);
 				s->status = STATUS_CONTENT;
 				if (size == 0) {
-					return;
+					return forward;
 				}
 			}
 		}
@@ -489,7 +576,7 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 			if (size < need) {
 				memcpy(s->recv_buffer + s->read, buffer, size);
 				s->read += size;
-				return;
+				return forward;
 			}
 			memcpy(s->recv_buffer + s->read, buffer, need);
 			forward_local_messsage(h, s->recv_buffer, s->length);
@@ -500,11 +587,11 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 			buffer += need;
 			s->status = STATUS_HEADER;
 			if (size == 0)
-				return;
+				return forward;
 			break;
 		}
 		default:
-			return;
+			return forward;
 		}
 	}
 }
@@ -556,7 +643,7 @@ remote_send_handle(struct harbor *h, uint32_t source, uint32_t destination, int
 		cookie.source = source;
 		cookie.destination = (destination & HANDLE_MASK) | ((uint32_t)type << HANDLE_REMOTE_SHIFT);
 		cookie.session = (uint32_t)session;
-		send_remote(context, s->fd, msg,sz,&cookie);
+		send_remote(h, harbor_id, msg,sz,&cookie);
 	}
 
 	return 0;
@@ -671,8 +758,9 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 		const struct skynet_socket_message * message = msg;
 		switch(message->type) {
 		case SKYNET_SOCKET_TYPE_DATA:
-			push_socket_data(h, message);
-			skynet_free(message->buffer);
+			if (!push_socket_data(h, message)) {
+				skynet_free(message->buffer);
+			}
 			break;
 		case SKYNET_SOCKET_TYPE_ERROR:
 		case SKYNET_SOCKET_TYPE_CLOSE: {
@@ -728,6 +816,16 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 	}
 }
 
+static void
+harbor_idle(struct skynet_context * context, void *ud, int mqlen) {
+	struct harbor * h = ud;
+	if (h->ndirty == 0)
+		return;
+	if (mqlen == 0 || ++h->rounds >= WRITE_BUFFER_ROUNDS) {
+		flush_all(h);
+	}
+}
+
 int
 harbor_init(struct harbor *h, struct skynet_context *ctx, const char * args) {
 	h->ctx = ctx;
@@ -743,6 +841,7 @@ harbor_init(struct harbor *h, struct skynet_context *ctx, const char * args) {
 		close_all_remotes(h);
 	}
 	skynet_callback(ctx, h, mainloop);
+	skynet_idle(ctx, h, harbor_idle);
 	skynet_harbor_start(ctx);
 
 	return 0;
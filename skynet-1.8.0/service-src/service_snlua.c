@@ -7,8 +7,10 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include <time.h>
 
 #if defined(__APPLE__)
@@ -31,6 +33,15 @@ struct snlua {
 	size_t mem_limit;
 	lua_State * activeL;
 	ATOM_INT trap;
+	// gc driven by skynet_idle, see skynet.gcidle
+	bool gc_idle;
+	bool gc_cycle;
+	int gc_pause;
+	size_t gc_live;
+	size_t gc_mark;	// memory after the last step
+	uint64_t gc_steps;
+	uint64_t gc_cycles;
+	double gc_time;
 };
 
 // LUA_CACHELIB may defined in patched lua for shared proto
@@ -50,6 +61,7 @@ codecache(lua_State *L) {
 	luaL_Reg l[] = {
 		{ "clear", cleardummy },
 		{ "mode", cleardummy },
+		{ "stat", cleardummy },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
@@ -326,6 +338,24 @@ lstop(lua_State *L) {
 	return 1;
 }
 
+static int
+lgcstat(lua_State *L) {
+	void *ud = NULL;
+	lua_getallocf(L, &ud);
+	struct snlua *l = (struct snlua *)ud;
+	if (!l->gc_idle) {
+		return 0;
+	}
+	lua_createtable(L, 0, 3);
+	lua_pushinteger(L, l->gc_steps);
+	lua_setfield(L, -2, "steps");
+	lua_pushinteger(L, l->gc_cycles);
+	lua_setfield(L, -2, "cycles");
+	lua_pushnumber(L, l->gc_time);
+	lua_setfield(L, -2, "time");
+	return 1;
+}
+
 static int
 init_profile(lua_State *L) {
 	luaL_Reg l[] = {
@@ -333,6 +363,7 @@ init_profile(lua_State *L) {
 		{ "stop", lstop },
 		{ "resume", luaB_coresume },
 		{ "wrap", luaB_cowrap },
+		{ "gcstat", lgcstat },
 		{ NULL, NULL },
 	};
 	luaL_newlibtable(L,l);
@@ -380,6 +411,50 @@ optstring(struct skynet_context *ctx, const char *key, const char * str) {
 	return ret;
 }
 
+static void init_finish(struct snlua *l, struct skynet_context *ctx);
+
+// init_finish runs out of pcall, so never raise an error for the bad values
+static int
+opt_integer(lua_State *L, int index, int def) {
+	int isnum;
+	lua_Integer v = lua_tointegerx(L, index, &isnum);
+	if (!isnum || v <= 0 || v > INT_MAX)
+		return def;
+	return (int)v;
+}
+
+/*
+	The collector is stopped, and runs one step after a dispatch batch.
+	A cycle starts when the memory grows over pause/2 since the last cycle and the queue is empty,
+	or over pause (like the lua collector) when the service is busy.
+	Each step pays for the memory allocated since the last step, so the cycle keeps up with the allocation.
+ */
+static void
+gc_idle(struct skynet_context *ctx, void *ud, int mqlen) {
+	struct snlua *l = ud;
+	int debt = 0;	// in K, 0 for a basic step
+	if (!l->gc_cycle) {
+		int pause = mqlen == 0 ? 100 + (l->gc_pause - 100) / 2 : l->gc_pause;
+		if (l->mem <= l->gc_live / 100 * pause)
+			return;
+		l->gc_cycle = true;
+	} else if (l->mem > l->gc_mark) {
+		size_t k = (l->mem - l->gc_mark) / 1024;
+		debt = k > INT_MAX ? INT_MAX : (int)k;
+	}
+	double start = get_time();
+	int finish = lua_gc(l->L, LUA_GCSTEP, debt);
+	l->gc_mark = l->mem;
+	if (finish) {
+		l->gc_cycle = false;
+		l->gc_live = l->mem;
+		++l->gc_cycles;
+	}
+	++l->gc_steps;
+	l->gc_time += diff_time(start);
+}
+static int bind_cb(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz);
+
 static int
 init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t sz) {
 	lua_State *L = l->L;
@@ -432,12 +507,25 @@ init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t s
 		return 1;
 	}
 	lua_pushlstring(L, args, sz);
-	r = lua_pcall(L,1,0,1);
+	r = lua_pcall(L,1,1,1);
 	if (r != LUA_OK) {
 		skynet_error(ctx, "lua loader error : %s", lua_tostring(L, -1));
 		report_launcher_error(ctx);
 		return 1;
 	}
+	if (lua_type(L, -1) == LUA_TFUNCTION) {
+		// template mode, the loader returns the service main, call it in bind_cb
+		lua_setfield(L, LUA_REGISTRYINDEX, "skynet_template");
+		skynet_callback(ctx, l, bind_cb);
+	}
+	init_finish(l, ctx);
+
+	return 0;
+}
+
+static void
+init_finish(struct snlua *l, struct skynet_context *ctx) {
+	lua_State *L = l->L;
 	lua_settop(L,0);
 	if (lua_getfield(L, LUA_REGISTRYINDEX, "memlimit") == LUA_TNUMBER) {
 		size_t limit = lua_tointeger(L, -1);
@@ -448,8 +536,56 @@ init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t s
 	}
 	lua_pop(L, 1);
 
-	lua_gc(L, LUA_GCRESTART, 0);
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "gcidle") == LUA_TTABLE) {
+		lua_getfield(L, -1, "pause");
+		lua_getfield(L, -2, "stepmul");
+		lua_getfield(L, -3, "stepsize");
+		int pause = opt_integer(L, -3, 200);
+		int stepmul = opt_integer(L, -2, 100);
+		int stepsize = opt_integer(L, -1, 13);
+		lua_pop(L, 3);
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "gcidle");
+		lua_gc(L, LUA_GCINC, pause, stepmul, stepsize);
+		l->gc_idle = true;
+		l->gc_pause = pause;
+		l->gc_live = l->mem;
+		skynet_idle(ctx, l, gc_idle);
+		skynet_error(ctx, "Set gc idle mode, pause = %d, stepmul = %d, stepsize = %d", pause, stepmul, stepsize);
+	}
+	lua_pop(L, 1);
+
+	if (!l->gc_idle) {
+		lua_gc(L, LUA_GCRESTART, 0);
+	}
+}
 
+// a warmed service binds to its real args by the first text message from launcher
+static int
+bind_cb(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz) {
+	struct snlua *l = ud;
+	lua_State *L = l->L;
+	if (type != PTYPE_TEXT) {
+		if (session != 0) {
+			skynet_send(context, 0, source, PTYPE_ERROR, session, NULL, 0);
+		}
+		return 0;
+	}
+	skynet_callback(context, NULL, NULL);
+	lua_gc(L, LUA_GCSTOP, 0);
+	lua_settop(L, 0);
+	lua_pushcfunction(L, traceback);
+	lua_getfield(L, LUA_REGISTRYINDEX, "skynet_template");
+	lua_pushnil(L);
+	lua_setfield(L, LUA_REGISTRYINDEX, "skynet_template");
+	lua_pushlstring(L, msg, sz);
+	if (lua_pcall(L,1,0,1) != LUA_OK) {
+		skynet_error(context, "lua loader error : %s", lua_tostring(L, -1));
+		report_launcher_error(context);
+		skynet_command(context, "EXIT", NULL);
+		return 0;
+	}
+	init_finish(l, context);
 	return 0;
 }
 
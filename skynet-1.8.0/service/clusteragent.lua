@@ -1,4 +1,5 @@
 local skynet = require "skynet"
+require "skynet.manager"	-- inject skynet.forward_type
 local socket = require "skynet.socket"
 local cluster = require "skynet.cluster.core"
 local ignoreret = skynet.ignoreret
@@ -9,6 +10,7 @@ gate = tonumber(gate)
 fd = tonumber(fd)
 
 local large_request = {}
+local compressor = cluster.compressor(0)	-- the threshold is set by the option from clustersender
 local inquery_name = {}
 local register_name
 
@@ -46,6 +48,23 @@ local tracetag
 
 local function dispatch_request(_,_,addr, session, msg, sz, padding, is_push)
 	ignoreret()	-- session is fd, don't call skynet.ret
+	if type(addr) == "table" then
+		-- batch, see clustersender.lua. run the packages in order, each one in its own coroutine
+		for _, req in ipairs(addr) do
+			skynet.fork(dispatch_request, nil, nil, table.unpack(req, 1, req.n))
+		end
+		return
+	end
+	if addr == nil then
+		-- option, see clustersender.lua
+		local threshold = session:match "^lz4 (%d+)$"
+		if threshold then
+			compressor:threshold(tonumber(threshold))
+		else
+			skynet.error("Invalid cluster option " .. session)
+		end
+		return
+	end
 	if session == nil then
 		-- trace
 		tracetag = addr
@@ -63,7 +82,7 @@ local function dispatch_request(_,_,addr, session, msg, sz, padding, is_push)
 			tracetag = req.tracetag
 			large_request[session] = nil
 			cluster.append(req, msg, sz)
-			msg,sz = cluster.concat(req)
+			msg,sz = cluster.concat(req, compressor)
 			addr = req.addr
 			is_push = req.is_push
 		end
@@ -109,7 +128,7 @@ local function dispatch_request(_,_,addr, session, msg, sz, padding, is_push)
 		end
 	end
 	if ok then
-		response = cluster.packresponse(session, true, msg, sz)
+		response = cluster.packresponse(session, true, msg, sz, compressor)
 		if type(response) == "table" then
 			for _, v in ipairs(response) do
 				socket.lwrite(fd, v)
@@ -123,13 +142,15 @@ local function dispatch_request(_,_,addr, session, msg, sz, padding, is_push)
 	end
 end
 
-skynet.start(function()
-	skynet.register_protocol {
-		name = "client",
-		id = skynet.PTYPE_CLIENT,
-		unpack = cluster.unpackrequest,
-		dispatch = dispatch_request,
-	}
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	-- the message from gate is not freed (see forward_type below), unpackrequest reuses it for the payload
+	unpack = function(msg, sz) return cluster.unpackrequest(msg, sz, true, compressor) end,
+	dispatch = dispatch_request,
+}
+
+skynet.forward_type({ [skynet.PTYPE_CLIENT] = skynet.PTYPE_CLIENT }, function()
 	-- fd can write, but don't read fd, the data package will forward from gate though client protocol.
 	-- forward may fail, see https://github.com/cloudwu/skynet/issues/1958
 	pcall(skynet.call,gate, "lua", "forward", fd)
@@ -140,6 +161,8 @@ skynet.start(function()
 			skynet.exit()
 		elseif cmd == "namechange" then
 			new_register_name()
+		elseif cmd == "compressstat" then
+			skynet.retpack(compressor:stat())
 		else
 			skynet.error(string.format("Invalid command %s from %s", cmd, skynet.address(source)))
 		end
@@ -6,12 +6,79 @@ local config_name = skynet.getenv "cluster"
 local node_address = {}
 local node_sender = {}
 local node_sender_closed = {}
+local node_lanes = {}	-- node -> { sender, ..., large = sender }, see config __connections and __largepayload
 local command = {}
 local config = {}
 local nodename = cluster.nodename()
 
 local connecting = {}
 
+-- the config forwarded to each clustersender : __batch, __compress (threshold), __timeout, __adaptive
+local sender_config = { "batch", "compress", "timeout", "adaptive" }
+
+local function new_sender(key, host, port)
+	local c = skynet.newservice("clustersender", key, nodename, host, port)
+	for _, name in ipairs(sender_config) do
+		if config[name] then
+			skynet.send(c, "lua", name, config[name])
+		end
+	end
+	return c
+end
+
+local function foreach_sender(f)
+	for key, c in pairs(node_sender) do
+		f(key, c)
+	end
+	for key, lanes in pairs(node_lanes) do
+		for i = 2, #lanes do
+			f(key, lanes[i])
+		end
+		if lanes.large then
+			f(key, lanes.large)
+		end
+	end
+end
+
+-- extra connections to the node, lanes[1] is node_sender[key]
+local function open_lanes(key, host, port)
+	local n = config.connections or 1
+	local lanes = node_lanes[key]
+	if lanes == nil then
+		if n <= 1 and not config.largepayload then
+			return
+		end
+		lanes = {}
+		node_lanes[key] = lanes
+	end
+	lanes[1] = node_sender[key]
+	for i = 2, n do
+		lanes[i] = lanes[i] or new_sender(key, host, port)
+	end
+	if config.largepayload then
+		lanes.large = lanes.large or new_sender(key, host, port)
+	end
+	lanes.largepayload = config.largepayload
+	for i = 2, #lanes do
+		skynet.call(lanes[i], "lua", "changenode", host, port)
+	end
+	if lanes.large then
+		skynet.call(lanes.large, "lua", "changenode", host, port)
+	end
+end
+
+local function close_lanes(key)
+	local lanes = node_lanes[key]
+	if lanes then
+		for i = 2, #lanes do
+			pcall(skynet.call, lanes[i], "lua", "changenode", false)
+		end
+		if lanes.large then
+			pcall(skynet.call, lanes.large, "lua", "changenode", false)
+		end
+	end
+end
+
 local function open_channel(t, key)
 	local ct = connecting[key]
 	if ct then
@@ -42,7 +109,7 @@ local function open_channel(t, key)
 		local host, port = string.match(address, "([^:]+):(.*)$")
 		c = node_sender[key]
 		if c == nil then
-			c = skynet.newservice("clustersender", key, nodename, host, port)
+			c = new_sender(key, host, port)
 			if node_sender[key] then
 				-- double check
 				skynet.kill(c)
@@ -53,6 +120,9 @@ local function open_channel(t, key)
 		end
 
 		succ = pcall(skynet.call, c, "lua", "changenode", host, port)
+		if succ then
+			succ = pcall(open_lanes, key, host, port)
+		end
 
 		if succ then
 			t[key] = c
@@ -69,6 +139,7 @@ local function open_channel(t, key)
 		else
 			-- trun off the sender
 			succ, err = pcall(skynet.call, c, "lua", "changenode", false)
+			close_lanes(key)
                         if succ then --trun off failed, wait next index todo turn off
                                 node_sender_closed[key] = true
                         end
@@ -105,6 +176,13 @@ local function loadconfig(tmp)
 			name = name:sub(3)
 			config[name] = address
 			skynet.error(string.format("Config %s = %s", name, address))
+			for _, v in ipairs(sender_config) do
+				if name == v then
+					foreach_sender(function(_, c)
+						skynet.send(c, "lua", name, address)
+					end)
+				end
+			end
 		else
 			assert(address == false or type(address) == "string")
 			if node_address[name] ~= address then
@@ -161,10 +239,94 @@ function command.sender(source, node)
 	skynet.ret(skynet.pack(node_channel[node]))
 end
 
+-- all the senders of the node, see cluster.call
+function command.lanes(source, node)
+	local c = node_channel[node]
+	skynet.ret(skynet.pack(node_lanes[node] or c and { c }))
+end
+
 function command.senders(source)
 	skynet.retpack(node_sender)
 end
 
+local cluster_agent = {}	-- fd:service
+
+-- the stat of the lanes of a node are merged, the counters are summed
+local stat_max = { threshold = true, srtt = true, rttvar = true, timeout = true }
+
+local function sum_stat(total, stat)
+	for k, v in pairs(stat) do
+		if stat_max[k] then
+			total[k] = total[k] and math.max(total[k], v) or v
+		elseif k == "rtt_bucket" then
+			total[k] = v
+		elseif type(v) == "table" then
+			local t = total[k] or {}
+			total[k] = t
+			for i, n in ipairs(v) do
+				t[i] = (t[i] or 0) + n
+			end
+		else
+			total[k] = (total[k] or 0) + v
+		end
+	end
+end
+
+-- skynet.call yields, so collect the services first
+local function sender_stat(cmd)
+	local senders = {}
+	foreach_sender(function(key, c)
+		table.insert(senders, { key, c })
+	end)
+	local nodes = {}
+	for _, v in ipairs(senders) do
+		local ok, stat = pcall(skynet.call, v[2], "lua", cmd)
+		if ok then
+			local total = nodes[v[1]] or { connections = 0 }
+			nodes[v[1]] = total
+			sum_stat(total, stat)
+			total.connections = total.connections + 1
+		end
+	end
+	return nodes
+end
+
+-- in-flight requests, rtt histogram (ms), errors, timeouts, connects and bytes of the links to each node
+function command.stat(source, node)
+	local nodes = sender_stat "stat"
+	if node then
+		skynet.retpack(nodes[node])
+	else
+		skynet.retpack(nodes)
+	end
+end
+
+local function finish_stat(stat)
+	local raw = stat.raw + stat.decompress_raw
+	stat.saved = raw - stat.packed - stat.decompress_packed
+	stat.ratio = raw > 0 and (stat.packed + stat.decompress_packed) / raw or 1
+	return stat
+end
+
+-- compression counters : the outgoing links by node, and the incoming links by fd
+function command.compressstat(source)
+	local nodes = sender_stat "compressstat"
+	for _, stat in pairs(nodes) do
+		finish_stat(stat)
+	end
+	local agents = {}
+	for fd, agent in pairs(cluster_agent) do
+		if type(agent) == "number" then
+			agents[fd] = agent
+		end
+	end
+	for fd, agent in pairs(agents) do
+		local ok, stat = pcall(skynet.call, agent, "lua", "compressstat")
+		agents[fd] = ok and finish_stat(stat) or nil
+	end
+	skynet.retpack(nodes, agents)
+end
+
 local proxy = {}
 
 function command.proxy(source, node, name)
@@ -189,7 +351,6 @@ function command.proxy(source, node, name)
 	skynet.ret(skynet.pack(p))
 end
 
-local cluster_agent = {}	-- fd:service
 local register_name = {}
 
 local function clearnamecache()
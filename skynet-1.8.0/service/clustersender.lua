@@ -9,10 +9,134 @@ local node, nodename, init_host, init_port = ...
 
 local command = {}
 
+-- small packages are coalesced into one batch package when batch is on (config __batch), see lua-cluster.c
+local BATCH_LIMIT = 0xff00
+local batch
+local batch_size = 0
+local flushing = false
+
+-- the payload larger than the threshold is compressed (config __compress), see lua-cluster.c
+local compressor = cluster.compressor(0)
+local compress_option = 0	-- the threshold the peer knows
+
+-- the metrics of the link, see command.stat
+local RTT_BUCKET = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 }	-- ms, and one more bucket for the slower
+local metrics = {
+	requests = 0,
+	pushes = 0,
+	errors = 0,
+	timeouts = 0,
+	connects = 0,
+	inflight = 0,
+	bytes_out = 0,
+	bytes_in = 0,
+	rtt = {},
+}
+for i = 1, #RTT_BUCKET + 1 do
+	metrics.rtt[i] = 0
+end
+local srtt, rttvar	-- ms, smoothed as TCP does (RFC 6298)
+local last_stat = { time = skynet.now(), bytes_out = 0, bytes_in = 0 }
+
+-- no timeout by default, config __timeout (in 1/100 sec) is the fixed timeout,
+-- and config __adaptive makes it shorter by the rtt measured.
+local ADAPTIVE_MIN = 100
+local ADAPTIVE_FACTOR = 4
+local request_timeout
+local adaptive_timeout
+
+local function record_rtt(ms)
+	local rtt = metrics.rtt
+	local i = 1
+	while RTT_BUCKET[i] and ms > RTT_BUCKET[i] do
+		i = i + 1
+	end
+	rtt[i] = rtt[i] + 1
+	if srtt == nil then
+		srtt = ms
+		rttvar = ms / 2
+	else
+		rttvar = rttvar * 0.75 + math.abs(srtt - ms) * 0.25
+		srtt = srtt * 0.875 + ms * 0.125
+	end
+end
+
+local function get_timeout()
+	if request_timeout and adaptive_timeout and srtt then
+		local ti = math.ceil((srtt + 4 * rttvar) * ADAPTIVE_FACTOR / 10)
+		return math.min(request_timeout, math.max(ti, ADAPTIVE_MIN))
+	end
+	return request_timeout
+end
+
+local function count_out(request, padding)
+	local sz = #request
+	if padding then
+		for _, v in ipairs(padding) do
+			sz = sz + #v
+		end
+	end
+	metrics.bytes_out = metrics.bytes_out + sz
+end
+
+local function flush()
+	local n = #batch
+	if n == 0 then
+		return
+	end
+	local request = n == 1 and batch[1] or cluster.packbatch(batch)
+	batch = {}
+	batch_size = 0
+	channel:request(request)
+end
+
+local function delay_flush()
+	-- the requests already in the message queue join this batch, so the latency is bounded by one queue round
+	if skynet.mqlen() > 0 then
+		skynet.yield()
+	end
+	flushing = false
+	if batch then
+		flush()
+	end
+end
+
+local function write_request(request, padding)
+	count_out(request, padding)
+	if batch == nil then
+		return channel:request(request, nil, padding)
+	end
+	if padding then
+		-- multi part package is not batched, keep the order
+		flush()
+		return channel:request(request, nil, padding)
+	end
+	local sz = #request
+	if batch_size + sz > BATCH_LIMIT then
+		flush()
+	end
+	batch[#batch+1] = request
+	batch_size = batch_size + sz
+	if not flushing then
+		flushing = true
+		skynet.fork(delay_flush)
+	end
+end
+
+local function send_option()
+	local threshold = compressor:threshold()
+	if compress_option ~= threshold then
+		-- the peer compresses the responses after the option
+		compress_option = threshold
+		write_request(cluster.packoption("lz4 " .. threshold))
+	end
+end
+
 local function send_request(addr, msg, sz)
 	-- msg is a local pointer, cluster.packrequest will free it
+	send_option()
 	local current_session = session
-	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz)
+	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz, compressor)
 	session = new_session
 
 	local tracetag = skynet.tracetag()
@@ -24,38 +148,149 @@ local function send_request(addr, msg, sz)
 			tracetag = newtag
 		end
 		skynet.tracelog(tracetag, string.format("cluster %s", node))
-		channel:request(cluster.packtrace(tracetag))
+		write_request(cluster.packtrace(tracetag))
+	end
+	if batch then
+		write_request(request, padding)
+		return channel:response(current_session, true)
 	end
+	count_out(request, padding)
 	return channel:request(request, current_session, padding)
 end
 
+local function rawpack(...)
+	return ...
+end
+
 function command.req(...)
+	local ti = get_timeout()
+	local response, timedout
+	if ti then
+		response = skynet.response(rawpack)
+		skynet.timeout(ti, function()
+			if response then
+				timedout = true
+				metrics.timeouts = metrics.timeouts + 1
+				skynet.error(string.format("Cluster request to %s timeout (%d)", node, ti))
+				response(false)
+				response = nil
+			end
+		end)
+	end
+	metrics.requests = metrics.requests + 1
+	metrics.inflight = metrics.inflight + 1
+	local start = skynet.hpc()
 	local ok, msg = pcall(send_request, ...)
+	metrics.inflight = metrics.inflight - 1
+	if ok then
+		record_rtt((skynet.hpc() - start) / 1e6)
+	else
+		metrics.errors = metrics.errors + 1
+	end
+	if timedout then
+		-- drop the late response
+		return
+	end
 	if ok then
+		local sz
 		if type(msg) == "table" then
-			skynet.ret(cluster.concat(msg))
+			msg, sz = cluster.concat(msg, compressor)
+		end
+		if response then
+			response(true, msg, sz)
 		else
-			skynet.ret(msg)
+			skynet.ret(msg, sz)
 		end
 	else
 		skynet.error(msg)
-		skynet.response()(false)
+		if response then
+			response(false)
+		else
+			skynet.response()(false)
+		end
 	end
+	response = nil
 end
 
 function command.push(addr, msg, sz)
-	local request, new_session, padding = cluster.packpush(addr, session, msg, sz)
+	metrics.pushes = metrics.pushes + 1
+	send_option()
+	local request, new_session, padding = cluster.packpush(addr, session, msg, sz, compressor)
 	if padding then	-- is multi push
 		session = new_session
 	end
 
-	channel:request(request, nil, padding)
+	write_request(request, padding)
+end
+
+function command.batch(on)
+	if on then
+		batch = batch or {}
+	elseif batch then
+		local ok, err = pcall(flush)
+		batch = nil
+		if not ok then
+			skynet.error(err)
+		end
+	end
+end
+
+function command.compress(threshold)
+	compressor:threshold(threshold or 0)
+end
+
+function command.compressstat()
+	skynet.retpack(compressor:stat())
+end
+
+function command.timeout(ti)
+	request_timeout = ti or nil
+end
+
+function command.adaptive(on)
+	adaptive_timeout = on
+end
+
+function command.stat()
+	local now = skynet.now()
+	local stat = {}
+	for k, v in pairs(metrics) do
+		stat[k] = v
+	end
+	stat.rtt = table.move(metrics.rtt, 1, #metrics.rtt, 1, {})
+	stat.rtt_bucket = RTT_BUCKET
+	stat.srtt = srtt
+	stat.rttvar = rttvar
+	stat.timeout = get_timeout()
+	-- bytes per second since the last stat
+	local elapsed = math.max(now - last_stat.time, 1) / 100
+	stat.out_rate = (metrics.bytes_out - last_stat.bytes_out) / elapsed
+	stat.in_rate = (metrics.bytes_in - last_stat.bytes_in) / elapsed
+	last_stat.time = now
+	last_stat.bytes_out = metrics.bytes_out
+	last_stat.bytes_in = metrics.bytes_in
+	skynet.retpack(stat)
 end
 
 local function read_response(sock)
 	local sz = socket.header(sock:read(2))
-	local msg = sock:read(sz)
-	return cluster.unpackresponse(msg)	-- session, ok, data, padding
+	metrics.bytes_in = metrics.bytes_in + sz + 2
+	if sz < 5 then
+		return cluster.unpackresponse(sock:read(sz))
+	end
+	-- read the header and the payload apart, so that the payload string is not copied again
+	local header = sock:read(5)
+	return cluster.unpackresponse(header, sz > 5 and sock:read(sz - 5) or "", compressor)	-- session, ok, data, padding
+end
+
+-- a new connection, tell the peer the option again
+local function auth(ch)
+	metrics.connects = metrics.connects + 1
+	local threshold = compressor:threshold()
+	compress_option = threshold
+	if threshold > 0 then
+		ch:request(cluster.packoption("lz4 " .. threshold))
+	end
 end
 
 function command.changenode(host, port)
@@ -74,6 +309,7 @@ skynet.start(function()
 			host = init_host,
 			port = tonumber(init_port),
 			response = read_response,
+			auth = auth,
 			nodelay = true,
 		}
 	skynet.dispatch("lua", function(session , source, cmd, ...)
@@ -153,6 +153,7 @@ function COMMAND.help()
 		start = "lanuch a new lua service",
 		snax = "lanuch a new snax service",
 		clearcache = "clear lua code cache",
+		codecache = "show lua code cache stats",
 		service = "List unique service",
 		task = "task address : show service task detail",
 		uniqtask = "task address : show service unique task detail",
@@ -174,6 +175,7 @@ function COMMAND.help()
 		dbgcmd = "run address debug command",
 		getenv = "getenv name : skynet.getenv(name)",
 		setenv = "setenv name value: skynet.setenv(name,value)",
+		cluster = "cluster [node] : show the metrics of cluster links",
 	}
 end
 
@@ -181,6 +183,10 @@ function COMMAND.clearcache()
 	codecache.clear()
 end
 
+function COMMAND.codecache()
+	return codecache.stat()
+end
+
 function COMMAND.start(...)
 	local ok, addr = pcall(skynet.newservice, ...)
 	if ok then
@@ -464,6 +470,38 @@ function COMMAND.netstat()
 	return stat
 end
 
+local function convert_rtt(stat)
+	local rtt = {}
+	for i, n in ipairs(stat.rtt) do
+		local bucket = stat.rtt_bucket[i]
+		table.insert(rtt, string.format("%s%sms:%d", bucket and "<" or ">", bucket or stat.rtt_bucket[i-1], n))
+	end
+	stat.rtt = table.concat(rtt, " ")
+	stat.rtt_bucket = nil
+	stat.srtt = stat.srtt and string.format("%.2fms", stat.srtt)
+	stat.rttvar = stat.rttvar and string.format("%.2fms", stat.rttvar)
+	stat.bytes_in = bytes(stat.bytes_in)
+	stat.bytes_out = bytes(stat.bytes_out)
+	stat.in_rate = bytes(math.floor(stat.in_rate))
+	stat.out_rate = bytes(math.floor(stat.out_rate))
+end
+
+function COMMAND.cluster(node)
+	-- don't launch clusterd if the node is not in a cluster
+	local clusterd = skynet.call(".service", "lua", "LIST").clusterd
+	if type(clusterd) ~= "string" or clusterd:sub(1,1) ~= ":" then
+		return "No cluster"
+	end
+	local stat = skynet.call(clusterd, "lua", "stat")
+	if node then
+		stat = { [node] = stat[node] }
+	end
+	for _, v in pairs(stat) do
+		convert_rtt(v)
+	end
+	return stat
+end
+
 function COMMAND.dumpheap()
 	memory.dumpheap()
 end
@@ -2,6 +2,7 @@ local skynet = require "skynet"
 local gateserver = require "snax.gateserver"
 
 local watchdog
+local idformat	-- the string.pack format of the id field in conf.header
 local connection = {}	-- fd -> connection : { fd , client, agent , ip, mode }
 
 skynet.register_protocol {
@@ -13,18 +14,29 @@ local handler = {}
 
 function handler.open(source, conf)
 	watchdog = conf.watchdog or source
+	local endian, width = (conf.header or ""):match ",([<>]?)([1-4])$"
+	if width then
+		idformat = (endian == "" and ">" or endian) .. "I" .. width
+	end
 	return conf.address, conf.port
 end
 
-function handler.message(fd, msg, sz)
+function handler.message(fd, msg, sz, id)
 	-- recv a package, forward it
 	local c = connection[fd]
 	local agent = c.agent
 	if agent then
-		-- It's safe to redirect msg directly , gateserver framework will not free msg.
-		skynet.redirect(agent, c.client, "client", fd, msg, sz)
+		if id then
+			-- the same as the routed packages (gateserver.route), the id field is before the payload
+			local pack = string.pack(idformat, id) .. skynet.tostring(msg, sz)
+			skynet.trash(msg, sz)
+			skynet.redirect(agent, c.client, "client", fd, pack)
+		else
+			-- It's safe to redirect msg directly , gateserver framework will not free msg.
+			skynet.redirect(agent, c.client, "client", fd, msg, sz)
+		end
 	else
-		skynet.send(watchdog, "lua", "socket", "data", fd, skynet.tostring(msg, sz))
+		skynet.send(watchdog, "lua", "socket", "data", fd, skynet.tostring(msg, sz), id)
 		-- skynet.tostring will copy msg to a string, so we must free msg here.
 		skynet.trash(msg,sz)
 	end
@@ -43,6 +55,7 @@ local function unforward(c)
 	if c.agent then
 		c.agent = nil
 		c.client = nil
+		gateserver.route(c.fd)
 	end
 end
 
@@ -75,6 +88,13 @@ function CMD.forward(source, fd, client, address)
 	unforward(c)
 	c.client = client or 0
 	c.agent = address or source
+	if type(c.agent) == "string" and c.agent:byte() == 46 then	-- "."
+		c.agent = skynet.localname(c.agent) or c.agent
+	end
+	if math.type(c.agent) == "integer" then
+		-- send the packages to agent in C, don't enter lua
+		gateserver.route(fd, c.agent, c.client)
+	end
 	gateserver.openclient(fd)
 end
 
@@ -7,6 +7,7 @@ local services = {}
 local command = {}
 local instance = {} -- for confirm (function command.LAUNCH / command.ERROR / command.LAUNCHOK)
 local launch_session = {} -- for command.QUERY, service_address -> session
+local template = {} -- service name -> { size = n, warmed snlua instances ... }
 
 local function handle_to_address(handle)
 	return tonumber("0x" .. string.sub(handle , 2))
@@ -76,7 +77,46 @@ function command.GC(addr, ti)
 	return command.MEM(addr, ti)
 end
 
+local function warm(name)
+	local pool = template[name]
+	pool.warming = nil
+	while #pool < pool.size do
+		local inst = skynet.launch("snlua", "@template " .. name)
+		if not inst then
+			break
+		end
+		table.insert(pool, inst)
+	end
+end
+
+local function remove_template(handle)
+	for name, pool in pairs(template) do
+		for i, inst in ipairs(pool) do
+			if inst == handle then
+				table.remove(pool, i)
+				return
+			end
+		end
+	end
+end
+
+-- keep n warmed instances of snlua service name, see lualib/loader.lua
+function command.TEMPLATE(_, name, n)
+	local pool = template[name]
+	if not pool then
+		pool = { size = 0 }
+		template[name] = pool
+	end
+	pool.size = n
+	while #pool > n do
+		skynet.kill(table.remove(pool))
+	end
+	warm(name)
+	return #pool
+end
+
 function command.REMOVE(_, handle, kill)
+	remove_template(handle)
 	services[handle] = nil
 	local response = instance[handle]
 	if response then
@@ -92,7 +132,18 @@ end
 
 local function launch_service(service, ...)
 	local param = table.concat({...}, " ")
-	local inst = skynet.launch(service, param)
+	local inst
+	local pool = service == "snlua" and template[...]
+	if pool and #pool > 0 then
+		inst = table.remove(pool)
+		core.send(inst, skynet.PTYPE_TEXT, 0, param)
+		if not pool.warming then
+			pool.warming = true
+			skynet.fork(warm, (...))
+		end
+	else
+		inst = skynet.launch(service, param)
+	end
 	local session = skynet.context()
 	local response = skynet.response()
 	if inst then
@@ -128,6 +179,7 @@ function command.ERROR(address)
 		launch_session[address] = nil
 		instance[address] = nil
 	end
+	remove_template(address)
 	services[address] = nil
 	return NORET
 end
@@ -182,4 +234,12 @@ skynet.dispatch("lua", function(session, address, cmd , ...)
 	end
 end)
 
-skynet.start(function() end)
+skynet.start(function()
+	-- snlua_template = "agent:16,room:4"
+	local conf = skynet.getenv "snlua_template"
+	if conf then
+		for name, n in string.gmatch(conf, "([^:,%s]+):(%d+)") do
+			command.TEMPLATE(nil, name, tonumber(n))
+		end
+	end
+end)
@@ -0,0 +1,160 @@
+#ifndef SKYNET_FRAME_FORMAT_H
+#define SKYNET_FRAME_FORMAT_H
+
+/*
+	The header of the frames on a stream socket, shared by service_gate.c and lua-netpack.c
+
+	A frame is : length field, [id field], payload
+	The length counts the bytes after the length field (the id field and the payload).
+
+	The spec is "length[,id]"
+		length : [<>](1|2|3|4|v)
+		id : [<>](1|2|3|4)
+	'>' is big-endian (default), '<' is little-endian, 1-4 is the width in bytes,
+	'v' is a varint (7 bits per byte, the lower bits first, the same as protobuf).
+	"S" is ">2" and "L" is ">4", the old style of gate.
+
+	For example, "v,>2" is a varint length followed by a 2 bytes big-endian message id.
+ */
+
+#include <stdint.h>
+
+#define FRAME_VARINT 0
+#define FRAME_NONE -1
+#define FRAME_LENGTH_MAX 5	// the max bytes of the length field (varint uint32)
+
+struct frame_field {
+	int8_t width;	// 1-4, FRAME_VARINT or FRAME_NONE
+	int8_t little;
+};
+
+struct frame_format {
+	struct frame_field length;
+	struct frame_field id;
+};
+
+static inline void
+frame_format_default(struct frame_format *f) {
+	f->length.width = 2;
+	f->length.little = 0;
+	f->id.width = FRAME_NONE;
+	f->id.little = 0;
+}
+
+static inline const char *
+frame_field_parse(struct frame_field *field, const char *spec, int varint) {
+	field->little = 0;
+	if (*spec == '<' || *spec == '>') {
+		field->little = *spec == '<';
+		++spec;
+	}
+	if (*spec >= '1' && *spec <= '4') {
+		field->width = *spec - '0';
+	} else if (varint && *spec == 'v') {
+		field->width = FRAME_VARINT;
+	} else {
+		return NULL;
+	}
+	return spec + 1;
+}
+
+// returns 0 if the spec is valid
+static inline int
+frame_format_parse(struct frame_format *f, const char *spec) {
+	frame_format_default(f);
+	if (spec[0] == 'S' && spec[1] == '\0') {
+		return 0;
+	}
+	if (spec[0] == 'L' && spec[1] == '\0') {
+		f->length.width = 4;
+		return 0;
+	}
+	spec = frame_field_parse(&f->length, spec, 1);
+	if (spec == NULL)
+		return 1;
+	if (*spec == ',') {
+		spec = frame_field_parse(&f->id, spec + 1, 0);
+		if (spec == NULL)
+			return 1;
+	}
+	return *spec != '\0';
+}
+
+static inline uint32_t
+frame_read_fixed(const struct frame_field *field, const uint8_t *buf) {
+	uint32_t v = 0;
+	int i;
+	if (field->little) {
+		for (i=field->width-1;i>=0;i--) {
+			v = v << 8 | buf[i];
+		}
+	} else {
+		for (i=0;i<field->width;i++) {
+			v = v << 8 | buf[i];
+		}
+	}
+	return v;
+}
+
+static inline void
+frame_write_fixed(const struct frame_field *field, uint8_t *buf, uint32_t v) {
+	int i;
+	if (field->little) {
+		for (i=0;i<field->width;i++) {
+			buf[i] = v & 0xff;
+			v >>= 8;
+		}
+	} else {
+		for (i=field->width-1;i>=0;i--) {
+			buf[i] = v & 0xff;
+			v >>= 8;
+		}
+	}
+}
+
+static inline int
+frame_id_size(const struct frame_format *f) {
+	return f->id.width == FRAME_NONE ? 0 : f->id.width;
+}
+
+/*
+	Read the length field in buf (sz bytes),
+	returns the bytes of the length field, 0 if it's incomplete, -1 if it's invalid.
+	*size is the bytes after the length field.
+ */
+static inline int
+frame_length(const struct frame_format *f, const uint8_t *buf, int sz, uint32_t *size) {
+	int n;
+	if (f->length.width == FRAME_VARINT) {
+		uint32_t v = 0;
+		for (n=0;;n++) {
+			if (n >= sz)
+				return 0;
+			if (n == FRAME_LENGTH_MAX - 1 && buf[n] > 0x0f)
+				return -1;	// overflow uint32
+			v |= (uint32_t)(buf[n] & 0x7f) << (7 * n);
+			if ((buf[n] & 0x80) == 0)
+				break;
+		}
+		++n;
+		*size = v;
+	} else {
+		n = f->length.width;
+		if (sz < n)
+			return 0;
+		*size = frame_read_fixed(&f->length, buf);
+	}
+	if (*size < (uint32_t)frame_id_size(f))
+		return -1;
+	return n;
+}
+
+// returns the id at the head of the frame body (after the length field), the body is never shorter than the id field.
+static inline uint32_t
+frame_id(const struct frame_format *f, const uint8_t *body) {
+	if (f->id.width == FRAME_NONE)
+		return 0;
+	return frame_read_fixed(&f->id, body);
+}
+
+#endif
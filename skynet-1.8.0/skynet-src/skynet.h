@@ -23,6 +23,8 @@
 
 #define PTYPE_TAG_DONTCOPY 0x10000
 #define PTYPE_TAG_ALLOCSESSION 0x20000
+// msg is from skynet_shared_new, the sender gives one reference to the message
+#define PTYPE_TAG_SHARED 0x40000
 
 struct skynet_context;
 
@@ -36,9 +38,20 @@ int skynet_isremote(struct skynet_context *, uint32_t handle, int * harbor);
 
 typedef int (*skynet_cb)(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz);
 void skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb);
+// the callback never returns 1 for a shared message, so it can read the shared buffer without a copy
+void skynet_callback_shared(struct skynet_context * context, int enable);
+
+// called by the worker after each dispatch batch, mqlen is the messages left in the queue
+typedef void (*skynet_idle_cb)(struct skynet_context * context, void *ud, int mqlen);
+void skynet_idle(struct skynet_context * context, void *ud, skynet_idle_cb cb);
 
 uint32_t skynet_current_handle(void);
 uint64_t skynet_now(void);
 void skynet_debug_memory(const char *info);	// for debug use, output current service memory to stderr
 
+// refcounted immutable message buffer, released after each receiver's dispatch
+void * skynet_shared_new(size_t sz);
+void skynet_shared_grab(void *msg);
+void skynet_shared_release(void *msg);
+
 #endif
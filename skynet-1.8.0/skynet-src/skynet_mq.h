@@ -12,8 +12,10 @@ struct skynet_message {
 };
 
 // type is encoding in skynet_message.sz high 8bit
-#define MESSAGE_TYPE_MASK (SIZE_MAX >> 8)
+#define MESSAGE_TYPE_MASK (SIZE_MAX >> 9)
 #define MESSAGE_TYPE_SHIFT ((sizeof(size_t)-1) * 8)
+// the next bit marks a shared message (PTYPE_TAG_SHARED)
+#define MESSAGE_SHARED ((size_t)1 << (MESSAGE_TYPE_SHIFT-1))
 
 struct message_queue;
 
@@ -44,6 +44,8 @@ struct skynet_context {
 	struct skynet_module * mod;
 	void * cb_ud;
 	skynet_cb cb;
+	void * idle_ud;
+	skynet_idle_cb idle;
 	struct message_queue *queue;
 	ATOM_POINTER logfile;
 	uint64_t cpu_cost;	// in microsec
@@ -56,6 +58,7 @@ struct skynet_context {
 	bool init;
 	bool endless;
 	bool profile;
+	bool shared;	// the callback never reserves messages, see skynet_callback_shared
 
 	CHECKCALLING_DECL
 };
@@ -111,10 +114,49 @@ struct drop_t {
 	uint32_t handle;
 };
 
+struct shared_message {
+	ATOM_INT ref;
+	size_t sz;
+};
+
+// keep the data aligned
+#define SHARED_HEADER ((sizeof(struct shared_message) + 15) & ~15)
+
+void *
+skynet_shared_new(size_t sz) {
+	struct shared_message * m = skynet_malloc(SHARED_HEADER + sz);
+	ATOM_INIT(&m->ref, 1);
+	m->sz = sz;
+	return (char *)m + SHARED_HEADER;
+}
+
+void
+skynet_shared_grab(void *msg) {
+	struct shared_message * m = (struct shared_message *)((char *)msg - SHARED_HEADER);
+	ATOM_FINC(&m->ref);
+}
+
+void
+skynet_shared_release(void *msg) {
+	struct shared_message * m = (struct shared_message *)((char *)msg - SHARED_HEADER);
+	if (ATOM_FDEC(&m->ref) == 1) {
+		skynet_free(m);
+	}
+}
+
+static inline void
+free_message(void *data, size_t sz) {
+	if (sz & MESSAGE_SHARED) {
+		skynet_shared_release(data);
+	} else {
+		skynet_free(data);
+	}
+}
+
 static void
 drop_message(struct skynet_message *msg, void *ud) {
 	struct drop_t *d = ud;
-	skynet_free(msg->data);
+	free_message(msg->data, msg->sz);
 	uint32_t source = d->handle;
 	assert(source);
 	// report error to the message source
@@ -139,11 +181,14 @@ skynet_context_new(const char * name, const char *param) {
 	ATOM_INIT(&ctx->ref , 2);
 	ctx->cb = NULL;
 	ctx->cb_ud = NULL;
+	ctx->idle = NULL;
+	ctx->idle_ud = NULL;
 	ctx->session_id = 0;
 	ATOM_INIT(&ctx->logfile, (uintptr_t)NULL);
 
 	ctx->init = false;
 	ctx->endless = false;
+	ctx->shared = false;
 
 	ctx->cpu_cost = 0;
 	ctx->cpu_start = 0;
@@ -269,6 +314,14 @@ dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
 		skynet_log_output(f, msg->source, type, msg->session, msg->data, sz);
 	}
 	++ctx->message_count;
+	if ((msg->sz & MESSAGE_SHARED) && !ctx->shared) {
+		// the receiver may reserve the message (forward mode), give it a private copy
+		void * data = skynet_malloc(sz);
+		memcpy(data, msg->data, sz);
+		skynet_shared_release(msg->data);
+		msg->data = data;
+		msg->sz &= ~MESSAGE_SHARED;
+	}
 	int reserve_msg;
 	if (ctx->profile) {
 		ctx->cpu_start = skynet_thread_time();
@@ -279,7 +332,10 @@ dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
 		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
 	}
 	if (!reserve_msg) {
-		skynet_free(msg->data);
+		free_message(msg->data, msg->sz);
+	} else if (msg->sz & MESSAGE_SHARED) {
+		// other receivers may read it, keep the reference
+		skynet_error(ctx, "Can't reserve shared message from %x", msg->source);
 	}
 	CHECKCALLING_END(ctx)
 }
@@ -330,7 +386,7 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 		skynet_monitor_trigger(sm, msg.source , handle);
 
 		if (ctx->cb == NULL) {
-			skynet_free(msg.data);
+			free_message(msg.data, msg.sz);
 		} else {
 			dispatch_message(ctx, &msg);
 		}
@@ -338,6 +394,11 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 		skynet_monitor_trigger(sm, 0,0);
 	}
 
+	// the queue is still owned by this worker (not popped empty), so the service is not running elsewhere
+	if (ctx->idle) {
+		ctx->idle(ctx, ctx->idle_ud, skynet_mq_length(q));
+	}
+
 	assert(q == ctx->queue);
 	struct message_queue *nq = skynet_globalmq_pop();
 	if (nq) {
@@ -678,8 +739,9 @@ skynet_command(struct skynet_context * context, const char * cmd , const char *
 
 static void
 _filter_args(struct skynet_context * context, int type, int *session, void ** data, size_t * sz) {
-	int needcopy = !(type & PTYPE_TAG_DONTCOPY);
+	int needcopy = !(type & (PTYPE_TAG_DONTCOPY | PTYPE_TAG_SHARED));
 	int allocsession = type & PTYPE_TAG_ALLOCSESSION;
+	int shared = type & PTYPE_TAG_SHARED;
 	type &= 0xff;
 
 	if (allocsession) {
@@ -695,13 +757,32 @@ _filter_args(struct skynet_context * context, int type, int *session, void ** da
 	}
 
 	*sz |= (size_t)type << MESSAGE_TYPE_SHIFT;
+	if (shared) {
+		*sz |= MESSAGE_SHARED;
+	}
+}
+
+// harbor frees the message by skynet_free, so give it a private copy
+static void *
+unshare_message(void * data, size_t sz) {
+	if (!(sz & MESSAGE_SHARED)) {
+		return data;
+	}
+	sz &= MESSAGE_TYPE_MASK;
+	char * msg = skynet_malloc(sz+1);
+	memcpy(msg, data, sz);
+	msg[sz] = '\0';
+	skynet_shared_release(data);
+	return msg;
 }
 
 int
 skynet_send(struct skynet_context * context, uint32_t source, uint32_t destination , int type, int session, void * data, size_t sz) {
 	if ((sz & MESSAGE_TYPE_MASK) != sz) {
 		skynet_error(context, "The message to %x is too large", destination);
-		if (type & PTYPE_TAG_DONTCOPY) {
+		if (type & PTYPE_TAG_SHARED) {
+			skynet_shared_release(data);
+		} else if (type & PTYPE_TAG_DONTCOPY) {
 			skynet_free(data);
 		}
 		return -2;
@@ -715,7 +796,7 @@ skynet_send(struct skynet_context * context, uint32_t source, uint32_t destinati
 	if (destination == 0) {
 		if (data) {
 			skynet_error(context, "Destination address can't be 0");
-			skynet_free(data);
+			free_message(data, sz);
 			return -1;
 		}
 
@@ -724,7 +805,7 @@ skynet_send(struct skynet_context * context, uint32_t source, uint32_t destinati
 	if (skynet_harbor_message_isremote(destination)) {
 		struct remote_message * rmsg = skynet_malloc(sizeof(*rmsg));
 		rmsg->destination.handle = destination;
-		rmsg->message = data;
+		rmsg->message = unshare_message(data, sz);
 		rmsg->sz = sz & MESSAGE_TYPE_MASK;
 		rmsg->type = sz >> MESSAGE_TYPE_SHIFT;
 		skynet_harbor_send(rmsg, source, session);
@@ -736,7 +817,7 @@ skynet_send(struct skynet_context * context, uint32_t source, uint32_t destinati
 		smsg.sz = sz;
 
 		if (skynet_context_push(destination, &smsg)) {
-			skynet_free(data);
+			free_message(data, sz);
 			return -1;
 		}
 	}
@@ -754,7 +835,9 @@ skynet_sendname(struct skynet_context * context, uint32_t source, const char * a
 	} else if (addr[0] == '.') {
 		des = skynet_handle_findname(addr + 1);
 		if (des == 0) {
-			if (type & PTYPE_TAG_DONTCOPY) {
+			if (type & PTYPE_TAG_SHARED) {
+				skynet_shared_release(data);
+			} else if (type & PTYPE_TAG_DONTCOPY) {
 				skynet_free(data);
 			}
 			return -1;
@@ -762,7 +845,9 @@ skynet_sendname(struct skynet_context * context, uint32_t source, const char * a
 	} else {
 		if ((sz & MESSAGE_TYPE_MASK) != sz) {
 			skynet_error(context, "The message to %s is too large", addr);
-			if (type & PTYPE_TAG_DONTCOPY) {
+			if (type & PTYPE_TAG_SHARED) {
+				skynet_shared_release(data);
+			} else if (type & PTYPE_TAG_DONTCOPY) {
 				skynet_free(data);
 			}
 			return -2;
@@ -772,7 +857,7 @@ skynet_sendname(struct skynet_context * context, uint32_t source, const char * a
 		struct remote_message * rmsg = skynet_malloc(sizeof(*rmsg));
 		copy_name(rmsg->destination.name, addr);
 		rmsg->destination.handle = 0;
-		rmsg->message = data;
+		rmsg->message = unshare_message(data, sz);
 		rmsg->sz = sz & MESSAGE_TYPE_MASK;
 		rmsg->type = sz >> MESSAGE_TYPE_SHIFT;
 
@@ -794,6 +879,17 @@ skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb) {
 	context->cb_ud = ud;
 }
 
+void
+skynet_callback_shared(struct skynet_context * context, int enable) {
+	context->shared = enable;
+}
+
+void
+skynet_idle(struct skynet_context * context, void *ud, skynet_idle_cb cb) {
+	context->idle = cb;
+	context->idle_ud = ud;
+}
+
 void
 skynet_context_send(struct skynet_context * ctx, void * msg, size_t sz, uint32_t source, int type, int session) {
 	struct skynet_message smsg;
@@ -106,6 +106,12 @@ skynet_socket_poll() {
 	case SOCKET_WARNING:
 		forward_message(SKYNET_SOCKET_TYPE_WARNING, false, &result);
 		break;
+	case SOCKET_UDP_BATCH:
+		forward_message(SKYNET_SOCKET_TYPE_UDPBATCH, false, &result);
+		break;
+	case SOCKET_DRAIN:
+		forward_message(SKYNET_SOCKET_TYPE_DRAIN, false, &result);
+		break;
 	default:
 		skynet_error(NULL, "Unknown socket message type %d.",type);
 		return -1;
@@ -126,12 +132,23 @@ skynet_socket_sendbuffer_lowpriority(struct skynet_context *ctx, struct socket_s
 	return socket_server_send_lowpriority(SOCKET_SERVER, buffer);
 }
 
+int
+skynet_socket_sendbuffer_shared(struct skynet_context *ctx, const int *ids, int n, struct socket_sendbuffer *buffer) {
+	return socket_server_send_shared(SOCKET_SERVER, ids, n, buffer);
+}
+
 int 
 skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog) {
 	uint32_t source = skynet_context_handle(ctx);
 	return socket_server_listen(SOCKET_SERVER, source, host, port, backlog);
 }
 
+int
+skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog) {
+	uint32_t source = skynet_context_handle(ctx);
+	return socket_server_listen_reuseport(SOCKET_SERVER, source, host, port, backlog);
+}
+
 int 
 skynet_socket_connect(struct skynet_context *ctx, const char *host, int port) {
 	uint32_t source = skynet_context_handle(ctx);
@@ -174,6 +191,16 @@ skynet_socket_nodelay(struct skynet_context *ctx, int id) {
 	socket_server_nodelay(SOCKET_SERVER, id);
 }
 
+void
+skynet_socket_flowcontrol(struct skynet_context *ctx, int id, int64_t high, int64_t low, int droplow) {
+	socket_server_flowcontrol(SOCKET_SERVER, id, high, low, droplow);
+}
+
+int
+skynet_socket_blocked(struct skynet_context *ctx, int id) {
+	return socket_server_blocked(SOCKET_SERVER, id);
+}
+
 int 
 skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port) {
 	uint32_t source = skynet_context_handle(ctx);
@@ -197,6 +224,11 @@ skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr,
 	return socket_server_udp_connect(SOCKET_SERVER, id, addr, port);
 }
 
+void
+skynet_socket_udp_batch(struct skynet_context *ctx, int id, int enable) {
+	socket_server_udp_batch(SOCKET_SERVER, id, enable);
+}
+
 int 
 skynet_socket_udp_sendbuffer(struct skynet_context *ctx, const char * address, struct socket_sendbuffer *buffer) {
 	return socket_server_udp_send(SOCKET_SERVER, (const struct socket_udp_address *)address, buffer);
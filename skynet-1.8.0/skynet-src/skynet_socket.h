@@ -13,6 +13,8 @@ struct skynet_context;
 #define SKYNET_SOCKET_TYPE_ERROR 5
 #define SKYNET_SOCKET_TYPE_UDP 6
 #define SKYNET_SOCKET_TYPE_WARNING 7
+#define SKYNET_SOCKET_TYPE_UDPBATCH 8
+#define SKYNET_SOCKET_TYPE_DRAIN 9
 
 struct skynet_socket_message {
 	int type;
@@ -29,7 +31,9 @@ void skynet_socket_updatetime();
 
 int skynet_socket_sendbuffer(struct skynet_context *ctx, struct socket_sendbuffer *buffer);
 int skynet_socket_sendbuffer_lowpriority(struct skynet_context *ctx, struct socket_sendbuffer *buffer);
+int skynet_socket_sendbuffer_shared(struct skynet_context *ctx, const int *ids, int n, struct socket_sendbuffer *buffer);
 int skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog);
+int skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog);
 int skynet_socket_connect(struct skynet_context *ctx, const char *host, int port);
 int skynet_socket_bind(struct skynet_context *ctx, int fd);
 void skynet_socket_close(struct skynet_context *ctx, int id);
@@ -37,9 +41,12 @@ void skynet_socket_shutdown(struct skynet_context *ctx, int id);
 void skynet_socket_start(struct skynet_context *ctx, int id);
 void skynet_socket_pause(struct skynet_context *ctx, int id);
 void skynet_socket_nodelay(struct skynet_context *ctx, int id);
+void skynet_socket_flowcontrol(struct skynet_context *ctx, int id, int64_t high, int64_t low, int droplow);
+int skynet_socket_blocked(struct skynet_context *ctx, int id);
 
 int skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port);
+void skynet_socket_udp_batch(struct skynet_context *ctx, int id, int enable);
 int skynet_socket_udp_dial(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_listen(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_sendbuffer(struct skynet_context *ctx, const char * address, struct socket_sendbuffer *buffer);
@@ -10,6 +10,14 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 
+#ifdef USE_EPOLLET
+// Edge triggered : write event is always registered, socket_server reads/writes until EAGAIN.
+#define SP_EDGE_TRIGGER
+#define SP_EDGE_FLAGS (EPOLLOUT | EPOLLET)
+#else
+#define SP_EDGE_FLAGS 0
+#endif
+
 static bool 
 sp_invalid(int efd) {
 	return efd == -1;
@@ -28,7 +36,7 @@ sp_release(int efd) {
 static int 
 sp_add(int efd, int sock, void *ud) {
 	struct epoll_event ev;
-	ev.events = EPOLLIN;
+	ev.events = EPOLLIN | SP_EDGE_FLAGS;
 	ev.data.ptr = ud;
 	if (epoll_ctl(efd, EPOLL_CTL_ADD, sock, &ev) == -1) {
 		return 1;
@@ -44,7 +52,7 @@ sp_del(int efd, int sock) {
 static int
 sp_enable(int efd, int sock, void *ud, bool read_enable, bool write_enable) {
 	struct epoll_event ev;
-	ev.events = (read_enable ? EPOLLIN : 0) | (write_enable ? EPOLLOUT : 0);
+	ev.events = (read_enable ? EPOLLIN : 0) | (write_enable ? EPOLLOUT : 0) | SP_EDGE_FLAGS;
 	ev.data.ptr = ud;
 	if (epoll_ctl(efd, EPOLL_CTL_MOD, sock, &ev) == -1) {
 		return 1;
@@ -18,6 +18,8 @@ struct socket_info {
 	uint64_t write;
 	uint64_t rtime;
 	uint64_t wtime;
+	uint64_t rcall;
+	uint64_t wcall;
 	int64_t wbuffer;
 	uint8_t reading;
 	uint8_t writing;
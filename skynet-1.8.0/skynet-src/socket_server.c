@@ -1,3 +1,7 @@
+#ifdef __linux__
+#define _GNU_SOURCE	// for recvmmsg/sendmmsg
+#endif
+
 #include "skynet.h"
 
 #include "socket_server.h"
@@ -7,6 +11,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <errno.h>
@@ -18,9 +23,10 @@
 #include <string.h>
 
 #define MAX_INFO 128
-// MAX_SOCKET will be 2^MAX_SOCKET_P
-#define MAX_SOCKET_P 16
 #define MAX_EVENT 64
+#define MAX_IOVEC 64
+// read/accept up to MAX_DRAIN times for one event before polling other sockets
+#define MAX_DRAIN 64
 #define MIN_READ_BUFFER 64
 #define SOCKET_TYPE_INVALID 0
 #define SOCKET_TYPE_RESERVE 1
@@ -33,8 +39,6 @@
 #define SOCKET_TYPE_PACCEPT 8
 #define SOCKET_TYPE_BIND 9
 
-#define MAX_SOCKET (1<<MAX_SOCKET_P)
-
 #define PRIORITY_HIGH 0
 #define PRIORITY_LOW 1
 
@@ -50,6 +54,38 @@
 
 #define MAX_UDP_PACKAGE 65535
 
+#ifdef __linux__
+// read/write up to UDP_BATCH datagrams in one syscall
+#define UDP_BATCH 16
+#else
+#define UDP_BATCH 1
+
+// recvmmsg/sendmmsg is not available, send/recv one datagram each time.
+
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+
+static int
+recvmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout) {
+	ssize_t n = recvmsg(fd, &msgvec[0].msg_hdr, flags);
+	if (n < 0)
+		return -1;
+	msgvec[0].msg_len = (unsigned int)n;
+	return 1;
+}
+
+static int
+sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags) {
+	ssize_t n = sendmsg(fd, &msgvec[0].msg_hdr, flags);
+	if (n < 0)
+		return -1;
+	msgvec[0].msg_len = (unsigned int)n;
+	return 1;
+}
+#endif
+
 // EAGAIN and EWOULDBLOCK may be not the same value.
 #if (EAGAIN != EWOULDBLOCK)
 #define AGAIN_WOULDBLOCK EAGAIN : case EWOULDBLOCK
@@ -60,13 +96,14 @@
 #define WARNING_SIZE (1024*1024)
 
 #define USEROBJECT ((size_t)(-1))
+#define SHAREDOBJECT ((size_t)(-2))
 
 struct write_buffer {
 	struct write_buffer * next;
 	const void *buffer;
 	char *ptr;
 	size_t sz;
-	bool userobject;
+	void (*free_func)(void *);
 };
 
 struct write_buffer_udp {
@@ -84,6 +121,8 @@ struct socket_stat {
 	uint64_t wtime;
 	uint64_t read;
 	uint64_t write;
+	uint64_t rcall;	// read syscalls
+	uint64_t wcall;	// write syscalls
 };
 
 struct socket {
@@ -100,8 +139,15 @@ struct socket {
 	bool reading;
 	bool writing;
 	bool closing;
+	bool flushing;
 	ATOM_INT udpconnecting;
+	bool udp_batch;	// pack the datagrams read by one recvmmsg into SOCKET_UDP_BATCH, See socket_server_udp_batch
 	int64_t warn_size;
+	// flow control, See socket_server_flowcontrol
+	int64_t wb_high;
+	int64_t wb_low;
+	bool drop_low;
+	ATOM_INT blocked;	// wb_size reached wb_high and hasn't drained to wb_low, read by socket_server_send
 	union {
 		int size;
 		uint8_t udp_address[UDP_ADDRESS_SIZE];
@@ -112,6 +158,8 @@ struct socket {
 	size_t dw_size;
 };
 
+struct send_broadcast;
+
 struct socket_server {
 	volatile uint64_t time;
 	int reserve_fd;	// for EMFILE
@@ -122,11 +170,17 @@ struct socket_server {
 	ATOM_INT alloc_id;
 	int event_n;
 	int event_index;
+	int drain_n;
 	struct socket_object_interface soi;
+	struct send_broadcast *broadcast;
+#ifdef SP_EDGE_TRIGGER
+	int flush_n;
+	int flush[MAX_SOCKET];	// slot index of the sockets to be sent after ctrl commands
+#endif
 	struct event ev[MAX_EVENT];
 	struct socket slot[MAX_SOCKET];
 	char buffer[MAX_INFO];
-	uint8_t udpbuffer[MAX_UDP_PACKAGE];
+	uint8_t udpbuffer[UDP_BATCH][MAX_UDP_PACKAGE];
 	fd_set rfds;
 };
 
@@ -183,6 +237,22 @@ struct request_setopt {
 	int value;
 };
 
+struct request_broadcast {
+	struct send_broadcast *broadcast;
+};
+
+struct request_flow {
+	int id;
+	int drop;
+	int64_t high;
+	int64_t low;
+};
+
+struct request_udpbatch {
+	int id;
+	int enable;
+};
+
 struct request_udp {
 	int id;
 	int fd;
@@ -209,11 +279,14 @@ struct request_dial_udp {
 	W Enable write
 	D Send package (high)
 	P Send package (low)
+	M Send shared package to multiple sockets (broadcast)
 	A Send UDP package
 	C set udp address
 	N client dial to UDP host port
 	T Set opt
 	U Create UDP socket
+	F Set flow control
+	G Set udp batch
  */
 
 struct request_package {
@@ -223,11 +296,14 @@ struct request_package {
 		struct request_open open;
 		struct request_send send;
 		struct request_send_udp send_udp;
+		struct request_broadcast broadcast;
 		struct request_close close;
 		struct request_listen listen;
 		struct request_bind bind;
 		struct request_resumepause resumepause;
 		struct request_setopt setopt;
+		struct request_flow flow;
+		struct request_udpbatch udpbatch;
 		struct request_udp udp;
 		struct request_setudp set_udp;
 		struct request_dial_udp dial_udp;
@@ -247,6 +323,20 @@ struct send_object {
 	void (*free_func)(void *);
 };
 
+// One payload queued on many sockets. It's only referenced by the socket thread, so ref needn't be atomic.
+struct shared_buffer {
+	int ref;
+	const void * origin;
+	struct send_object so;
+};
+
+struct send_broadcast {
+	struct shared_buffer *buffer;
+	int n;
+	int index;
+	int id[1];
+};
+
 #define MALLOC skynet_malloc
 #define FREE skynet_free
 
@@ -293,18 +383,30 @@ socket_invalid(struct socket *s, int id) {
 	return (s->id != id || ATOM_LOAD(&s->type) == SOCKET_TYPE_INVALID);
 }
 
-static inline bool
+static void
+shared_buffer_release(void *ptr) {
+	struct shared_buffer *sb = ptr;
+	if (--sb->ref == 0) {
+		sb->so.free_func((void *)sb->origin);
+		FREE(sb);
+	}
+}
+
+static inline void
 send_object_init(struct socket_server *ss, struct send_object *so, const void *object, size_t sz) {
 	if (sz == USEROBJECT) {
 		so->buffer = ss->soi.buffer(object);
 		so->sz = ss->soi.size(object);
 		so->free_func = ss->soi.free;
-		return true;
+	} else if (sz == SHAREDOBJECT) {
+		const struct shared_buffer *sb = object;
+		so->buffer = sb->so.buffer;
+		so->sz = sb->so.sz;
+		so->free_func = shared_buffer_release;
 	} else {
 		so->buffer = object;
 		so->sz = sz;
 		so->free_func = FREE;
-		return false;
 	}
 }
 
@@ -338,11 +440,7 @@ send_object_init_from_sendbuffer(struct socket_server *ss, struct send_object *s
 
 static inline void
 write_buffer_free(struct socket_server *ss, struct write_buffer *wb) {
-	if (wb->userobject) {
-		ss->soi.free((void *)wb->buffer);
-	} else {
-		FREE((void *)wb->buffer);
-	}
+	wb->free_func((void *)wb->buffer);
 	FREE(wb);
 }
 
@@ -420,14 +518,21 @@ socket_server_create(uint64_t time) {
 	for (i=0;i<MAX_SOCKET;i++) {
 		struct socket *s = &ss->slot[i];
 		ATOM_INIT(&s->type, SOCKET_TYPE_INVALID);
+		ATOM_INIT(&s->blocked, 0);
 		clear_wb_list(&s->high);
 		clear_wb_list(&s->low);
 		spinlock_init(&s->dw_lock);
+		s->flushing = false;
 	}
 	ATOM_INIT(&ss->alloc_id , 0);
 	ss->event_n = 0;
 	ss->event_index = 0;
+	ss->drain_n = 0;
 	memset(&ss->soi, 0, sizeof(ss->soi));
+	ss->broadcast = NULL;
+#ifdef SP_EDGE_TRIGGER
+	ss->flush_n = 0;
+#endif
 	FD_ZERO(&ss->rfds);
 	assert(ss->recvctrl_fd < FD_SETSIZE);
 
@@ -500,6 +605,7 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 	assert(type != SOCKET_TYPE_RESERVE);
 	free_wb_list(ss,&s->high);
 	free_wb_list(ss,&s->low);
+	ATOM_STORE(&s->blocked, 0);
 	sp_del(ss->event_fd, s->fd);
 	socket_lock(l);
 	if (type != SOCKET_TYPE_BIND) {
@@ -533,6 +639,10 @@ socket_server_release(struct socket_server *ss) {
 		}
 		spinlock_destroy(&s->dw_lock);
 	}
+	if (ss->broadcast) {
+		shared_buffer_release(ss->broadcast->buffer);
+		FREE(ss->broadcast);
+	}
 	close(ss->sendctrl_fd);
 	close(ss->recvctrl_fd);
 	sp_release(ss->event_fd);
@@ -551,7 +661,12 @@ static inline int
 enable_write(struct socket_server *ss, struct socket *s, bool enable) {
 	if (s->writing != enable) {
 		s->writing = enable;
+#ifdef SP_EDGE_TRIGGER
+		// write event is always registered in edge triggered mode
+		return 0;
+#else
 		return sp_enable(ss->event_fd, s->fd, s, s->reading, enable);
+#endif
 	}
 	return 0;
 }
@@ -586,6 +701,11 @@ new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque,
 	s->opaque = opaque;
 	s->wb_size = 0;
 	s->warn_size = 0;
+	s->wb_high = 0;
+	s->wb_low = 0;
+	s->drop_low = false;
+	ATOM_STORE(&s->blocked, 0);
+	s->udp_batch = false;
 	check_wb_list(&s->high);
 	check_wb_list(&s->low);
 	s->dw_buffer = NULL;
@@ -598,16 +718,27 @@ new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque,
 	return s;
 }
 
+// Edge triggered poll doesn't report the socket again until new data comes,
+// so re-arm it when we stop reading (or accepting) before EAGAIN.
+static inline void
+rearm_event(struct socket_server *ss, struct socket *s) {
+#ifdef SP_EDGE_TRIGGER
+	sp_enable(ss->event_fd, s->fd, s, s->reading, s->writing);
+#endif
+}
+
 static inline void
 stat_read(struct socket_server *ss, struct socket *s, int n) {
 	s->stat.read += n;
 	s->stat.rtime = ss->time;
+	++s->stat.rcall;
 }
 
 static inline void
 stat_write(struct socket_server *ss, struct socket *s, int n) {
 	s->stat.write += n;
 	s->stat.wtime = ss->time;
+	++s->stat.wcall;
 }
 
 // return -1 when connecting
@@ -723,12 +854,22 @@ close_write(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 	}
 }
 
+// Gather up to MAX_IOVEC buffers of the list into one writev call.
 static int
 send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
 	while (list->head) {
+		struct iovec iov[MAX_IOVEC];
 		struct write_buffer * tmp = list->head;
+		int n = 0;
+		while (tmp && n < MAX_IOVEC) {
+			iov[n].iov_base = tmp->ptr;
+			iov[n].iov_len = tmp->sz;
+			++n;
+			tmp = tmp->next;
+		}
+		ssize_t sz;
 		for (;;) {
-			ssize_t sz = write(s->fd, tmp->ptr, tmp->sz);
+			sz = writev(s->fd, iov, n);
 			if (sz < 0) {
 				switch(errno) {
 				case EINTR:
@@ -738,17 +879,23 @@ send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 				}
 				return close_write(ss, s, l, result);
 			}
-			stat_write(ss,s,(int)sz);
-			s->wb_size -= sz;
-			if (sz != tmp->sz) {
+			break;
+		}
+		stat_write(ss,s,(int)sz);
+		s->wb_size -= sz;
+		int i;
+		for (i=0;i<n;i++) {
+			tmp = list->head;
+			if ((size_t)sz < tmp->sz) {
+				// write a part, send the rest later
 				tmp->ptr += sz;
 				tmp->sz -= sz;
 				return -1;
 			}
-			break;
+			sz -= tmp->sz;
+			list->head = tmp->next;
+			write_buffer_free(ss,tmp);
 		}
-		list->head = tmp->next;
-		write_buffer_free(ss,tmp);
 	}
 	list->tail = NULL;
 
@@ -788,33 +935,63 @@ drop_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struc
 	write_buffer_free(ss,tmp);
 }
 
+// Send up to UDP_BATCH datagrams of the list by one sendmmsg call.
 static int
 send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
 	while (list->head) {
+		struct mmsghdr msg[UDP_BATCH];
+		struct iovec iov[UDP_BATCH];
+		union sockaddr_all sa[UDP_BATCH];
 		struct write_buffer * tmp = list->head;
-		struct write_buffer_udp * udp = (struct write_buffer_udp *)tmp;
-		union sockaddr_all sa;
-		socklen_t sasz = udp_socket_address(s, udp->udp_address, &sa);
-		if (sasz == 0) {
-			skynet_error(NULL, "socket-server : udp (%d) type mismatch.", s->id);
-			drop_udp(ss, s, list, tmp);
-			return -1;
+		int n = 0;
+		while (tmp && n < UDP_BATCH) {
+			struct write_buffer_udp * udp = (struct write_buffer_udp *)tmp;
+			socklen_t sasz = udp_socket_address(s, udp->udp_address, &sa[n]);
+			if (sasz == 0) {
+				if (n > 0) {
+					// send the datagrams before it first
+					break;
+				}
+				skynet_error(NULL, "socket-server : udp (%d) type mismatch.", s->id);
+				drop_udp(ss, s, list, tmp);
+				return -1;
+			}
+			iov[n].iov_base = tmp->ptr;
+			iov[n].iov_len = tmp->sz;
+			memset(&msg[n].msg_hdr, 0, sizeof(msg[n].msg_hdr));
+			msg[n].msg_hdr.msg_name = &sa[n];
+			msg[n].msg_hdr.msg_namelen = sasz;
+			msg[n].msg_hdr.msg_iov = &iov[n];
+			msg[n].msg_hdr.msg_iovlen = 1;
+			++n;
+			tmp = tmp->next;
 		}
-		int err = sendto(s->fd, tmp->ptr, tmp->sz, 0, &sa.s, sasz);
-		if (err < 0) {
+		int sent = sendmmsg(s->fd, msg, n, 0);
+		if (sent < 0) {
 			switch(errno) {
 			case EINTR:
 			case AGAIN_WOULDBLOCK:
 				return -1;
 			}
 			skynet_error(NULL, "socket-server : udp (%d) sendto error %s.",s->id, strerror(errno));
-			drop_udp(ss, s, list, tmp);
+			drop_udp(ss, s, list, list->head);
+			return -1;
+		}
+		int i;
+		size_t bytes = 0;
+		for (i=0;i<sent;i++) {
+			tmp = list->head;
+			bytes += tmp->sz;
+			s->wb_size -= tmp->sz;
+			list->head = tmp->next;
+			write_buffer_free(ss,tmp);
+		}
+		stat_write(ss,s,(int)bytes);
+		if (sent < n) {
+			if (list->head == NULL)
+				list->tail = NULL;
 			return -1;
 		}
-		stat_write(ss,s,tmp->sz);
-		s->wb_size -= tmp->sz;
-		list->head = tmp->next;
-		write_buffer_free(ss,tmp);
 	}
 	list->tail = NULL;
 
@@ -861,6 +1038,19 @@ send_buffer_empty(struct socket *s) {
 	return (s->high.head == NULL && s->low.head == NULL);
 }
 
+static int
+check_drain(struct socket *s, struct socket_message *result) {
+	if (ATOM_LOAD(&s->blocked) && s->wb_size <= s->wb_low) {
+		ATOM_STORE(&s->blocked, 0);
+		result->opaque = s->opaque;
+		result->id = s->id;
+		result->ud = s->wb_size%1024 == 0 ? s->wb_size/1024 : s->wb_size/1024 + 1;
+		result->data = NULL;
+		return SOCKET_DRAIN;
+	}
+	return -1;
+}
+
 /*
 	Each socket has two write buffer list, high priority and low priority.
 
@@ -917,6 +1107,13 @@ send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l,
 			return report_error(s, result, "disable write failed");
 		}
 
+		int drain = check_drain(s, result);
+		if (drain != -1) {
+			// SOCKET_DRAIN instead of the last SOCKET_WARNING (ud = 0)
+			s->warn_size = 0;
+			return drain;
+		}
+
 		if(s->warn_size > 0){
 			s->warn_size = 0;
 			result->opaque = s->opaque;
@@ -932,13 +1129,19 @@ send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l,
 
 static int
 send_buffer(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
+#ifdef SP_EDGE_TRIGGER
+	// No more write event if we give up here, so wait for the direct write (it's short).
+	socket_lock(l);
+#else
 	if (!socket_trylock(l))
 		return -1;	// blocked by direct write, send later.
+#endif
 	if (s->dw_buffer) {
 		// add direct write buffer before high.head
 		struct write_buffer * buf = MALLOC(sizeof(*buf));
 		struct send_object so;
-		buf->userobject = send_object_init(ss, &so, (void *)s->dw_buffer, s->dw_size);
+		send_object_init(ss, &so, (void *)s->dw_buffer, s->dw_size);
+		buf->free_func = so.free_func;
 		buf->ptr = (char*)so.buffer+s->dw_offset;
 		buf->sz = so.sz - s->dw_offset;
 		buf->buffer = (void *)s->dw_buffer;
@@ -954,15 +1157,60 @@ send_buffer(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 	}
 	int r = send_buffer_(ss,s,l,result);
 	socket_unlock(l);
+	if (r == -1) {
+		r = check_drain(s, result);
+	}
 
 	return r;
 }
 
+#ifdef SP_EDGE_TRIGGER
+
+// A writable socket raises no more write event in edge triggered mode,
+// so the sockets whose send buffer was empty are sent after all the pending ctrl commands (See flush_socket).
+static inline void
+flush_later(struct socket_server *ss, struct socket *s) {
+	if (!s->flushing) {
+		s->flushing = true;
+		ss->flush[ss->flush_n++] = HASH_ID(s->id);
+	}
+}
+
+static int
+flush_socket(struct socket_server *ss, struct socket_message *result) {
+	while (ss->flush_n > 0) {
+		struct socket *s = &ss->slot[ss->flush[--ss->flush_n]];
+		s->flushing = false;
+		switch (ATOM_LOAD(&s->type)) {
+		case SOCKET_TYPE_INVALID:
+		case SOCKET_TYPE_RESERVE:
+		case SOCKET_TYPE_CONNECTING:
+		case SOCKET_TYPE_HALFCLOSE_WRITE:
+			continue;
+		}
+		struct socket_lock l;
+		socket_lock_init(s, &l);
+		int type = send_buffer(ss, s, &l, result);
+		if (type != -1)
+			return type;
+	}
+	return -1;
+}
+
+#else
+
+static inline void
+flush_later(struct socket_server *ss, struct socket *s) {
+}
+
+#endif
+
 static struct write_buffer *
 append_sendbuffer_(struct socket_server *ss, struct wb_list *s, struct request_send * request, int size) {
 	struct write_buffer * buf = MALLOC(size);
 	struct send_object so;
-	buf->userobject = send_object_init(ss, &so, request->buffer, request->sz);
+	send_object_init(ss, &so, request->buffer, request->sz);
+	buf->free_func = so.free_func;
 	buf->ptr = (char*)so.buffer;
 	buf->sz = so.sz;
 	buf->buffer = request->buffer;
@@ -998,6 +1246,40 @@ append_sendbuffer_low(struct socket_server *ss,struct socket *s, struct request_
 	s->wb_size += buf->sz;
 }
 
+// the low list is never uncomplete out of send_buffer_, so it can be dropped as a whole
+static void
+drop_low_list(struct socket_server *ss, struct socket *s) {
+	struct write_buffer *wb;
+	for (wb = s->low.head; wb; wb = wb->next) {
+		s->wb_size -= wb->sz;
+	}
+	free_wb_list(ss, &s->low);
+}
+
+static int
+flow_socket(struct socket_server *ss, struct request_flow *request, struct socket_message *result) {
+	int id = request->id;
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	if (socket_invalid(s, id)) {
+		return -1;
+	}
+	int64_t high = request->high > 0 ? request->high : 0;
+	int64_t low = request->low;
+	if (low < 0 || low >= high) {
+		low = high / 2;
+	}
+	s->wb_high = high;
+	s->wb_low = low;
+	s->drop_low = request->drop && high > 0;
+	if (high == 0) {
+		// disable, wakeup the blocked writer
+		s->wb_low = s->wb_size;
+	} else if (s->wb_size >= high) {
+		ATOM_STORE(&s->blocked, 1);
+	}
+	return check_drain(s, result);
+}
+
 static int
 trigger_write(struct socket_server *ss, struct request_send * request, struct socket_message *result) {
 	int id = request->id;
@@ -1007,6 +1289,7 @@ trigger_write(struct socket_server *ss, struct request_send * request, struct so
 	if (enable_write(ss, s, true)) {
 		return report_error(s, result, "enable write failed");
 	}
+	flush_later(ss, s);
 	return -1;
 }
 
@@ -1064,7 +1347,15 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 		if (enable_write(ss, s, true)) {
 			return report_error(s, result, "enable write failed");
 		}
+		if (type != SOCKET_TYPE_CONNECTING) {
+			flush_later(ss, s);
+		}
 	} else {
+		if (priority == PRIORITY_LOW && s->drop_low && s->wb_size >= s->wb_high) {
+			// over budget, drop the low priority package
+			so.free_func((void *)request->buffer);
+			return -1;
+		}
 		if (s->protocol == PROTOCOL_TCP) {
 			if (priority == PRIORITY_LOW) {
 				append_sendbuffer_low(ss, s, request);
@@ -1078,6 +1369,14 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 			append_sendbuffer_udp(ss,s,priority,request,udp_address);
 		}
 	}
+	if (s->wb_high > 0 && s->wb_size >= s->wb_high) {
+		if (s->drop_low) {
+			drop_low_list(ss, s);
+		}
+		if (s->wb_size >= s->wb_high) {
+			ATOM_STORE(&s->blocked, 1);
+		}
+	}
 	if (s->wb_size >= WARNING_SIZE && s->wb_size >= s->warn_size) {
 		s->warn_size = s->warn_size == 0 ? WARNING_SIZE *2 : s->warn_size*2;
 		result->opaque = s->opaque;
@@ -1268,6 +1567,16 @@ setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 	setsockopt(s->fd, IPPROTO_TCP, request->what, &v, sizeof(v));
 }
 
+static void
+udpbatch_socket(struct socket_server *ss, struct request_udpbatch *request) {
+	int id = request->id;
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	if (socket_invalid(s, id)) {
+		return;
+	}
+	s->udp_batch = request->enable != 0;
+}
+
 static void
 block_readpipe(int pipefd, void *buffer, int sz) {
 	for (;;) {
@@ -1394,6 +1703,28 @@ dec_sending_ref(struct socket_server *ss, int id) {
 	}
 }
 
+// Queue the shared buffer on each socket of ss->broadcast in turn.
+// send_socket may raise a message (SOCKET_WARNING, etc.) for one socket, so return it and continue in next poll.
+static int
+broadcast_socket(struct socket_server *ss, struct socket_message *result) {
+	struct send_broadcast *b = ss->broadcast;
+	while (b->index < b->n) {
+		struct request_send request;
+		request.id = b->id[b->index++];
+		request.buffer = b->buffer;
+		request.sz = SHAREDOBJECT;
+		++b->buffer->ref;
+		int ret = send_socket(ss, &request, result, PRIORITY_HIGH, NULL);
+		dec_sending_ref(ss, request.id);
+		if (ret != -1)
+			return ret;
+	}
+	ss->broadcast = NULL;
+	shared_buffer_release(b->buffer);
+	FREE(b);
+	return -1;
+}
+
 // return type
 static int
 ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
@@ -1435,6 +1766,9 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 		dec_sending_ref(ss, request->id);
 		return ret;
 	}
+	case 'M':
+		ss->broadcast = ((struct request_broadcast *)buffer)->broadcast;
+		return broadcast_socket(ss, result);
 	case 'A': {
 		struct request_send_udp * rsu = (struct request_send_udp *)buffer;
 		return send_socket(ss, &rsu->send, result, PRIORITY_HIGH, rsu->address);
@@ -1449,6 +1783,11 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	case 'U':
 		add_udp_socket(ss, (struct request_udp *)buffer);
 		return -1;
+	case 'F':
+		return flow_socket(ss, (struct request_flow *)buffer, result);
+	case 'G':
+		udpbatch_socket(ss, (struct request_udpbatch *)buffer);
+		return -1;
 	default:
 		skynet_error(NULL, "socket-server: Unknown ctrl %c.",type);
 		return -1;
@@ -1538,11 +1877,37 @@ gen_udp_address(int protocol, union sockaddr_all *sa, uint8_t * udp_address) {
 	return addrsz;
 }
 
+static inline int
+udp_address_size(int protocol) {
+	return protocol == PROTOCOL_UDP ? 1+2+4 : 1+2+16;
+}
+
+static inline int
+udp_protocol(socklen_t slen) {
+	return slen == sizeof(struct sockaddr_in) ? PROTOCOL_UDP : PROTOCOL_UDPv6;
+}
+
+/*
+	Read one datagram, or up to UDP_BATCH datagrams by one recvmmsg call when udp_batch is set.
+	One datagram is forwarded as SOCKET_UDP (payload + address),
+	more than one are packed into one SOCKET_UDP_BATCH message, see socket_server.h .
+ */
 static int
 forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
-	union sockaddr_all sa;
-	socklen_t slen = sizeof(sa);
-	int n = recvfrom(s->fd, ss->udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
+	struct mmsghdr msg[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	union sockaddr_all sa[UDP_BATCH];
+	int i;
+	for (i=0;i<UDP_BATCH;i++) {
+		iov[i].iov_base = ss->udpbuffer[i];
+		iov[i].iov_len = MAX_UDP_PACKAGE;
+		memset(&msg[i].msg_hdr, 0, sizeof(msg[i].msg_hdr));
+		msg[i].msg_hdr.msg_name = &sa[i];
+		msg[i].msg_hdr.msg_namelen = sizeof(sa[i]);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	int n = recvmmsg(s->fd, msg, s->udp_batch ? UDP_BATCH : 1, 0, NULL);
 	if (n<0) {
 		switch(errno) {
 		case EINTR:
@@ -1555,28 +1920,59 @@ forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lo
 		result->data = strerror(error);
 		return SOCKET_ERR;
 	}
-	stat_read(ss,s,n);
 
-	uint8_t * data;
-	if (slen == sizeof(sa.v4)) {
-		if (s->protocol != PROTOCOL_UDP)
-			return -1;
-		data = MALLOC(n + 1 + 2 + 4);
-		gen_udp_address(PROTOCOL_UDP, &sa, data + n);
-	} else {
-		if (s->protocol != PROTOCOL_UDPv6)
-			return -1;
-		data = MALLOC(n + 1 + 2 + 16);
-		gen_udp_address(PROTOCOL_UDPv6, &sa, data + n);
+	int count = 0;
+	size_t bytes = 0;
+	size_t total = 0;
+	for (i=0;i<n;i++) {
+		bytes += msg[i].msg_len;
+		if (udp_protocol(msg[i].msg_hdr.msg_namelen) != s->protocol) {
+			// protocol mismatch, drop it
+			msg[i].msg_hdr.msg_namelen = 0;
+			continue;
+		}
+		++count;
+		total += sizeof(uint32_t) + 1 + udp_address_size(s->protocol) + msg[i].msg_len;
 	}
-	memcpy(data, ss->udpbuffer, n);
+	stat_read(ss,s,(int)bytes);
+	if (count == 0)
+		return -1;
 
 	result->opaque = s->opaque;
 	result->id = s->id;
-	result->ud = n;
+
+	if (count == 1) {
+		for (i=0;msg[i].msg_hdr.msg_namelen == 0;i++);
+		int sz = msg[i].msg_len;
+		uint8_t * data = MALLOC(sz + udp_address_size(s->protocol));
+		gen_udp_address(s->protocol, &sa[i], data + sz);
+		memcpy(data, ss->udpbuffer[i], sz);
+
+		result->ud = sz;
+		result->data = (char *)data;
+		return SOCKET_UDP;
+	}
+
+	uint8_t * data = MALLOC(total);
+	uint8_t * ptr = data;
+	for (i=0;i<n;i++) {
+		if (msg[i].msg_hdr.msg_namelen == 0)
+			continue;
+		uint32_t sz = msg[i].msg_len;
+		memcpy(ptr, &sz, sizeof(sz));
+		ptr += sizeof(sz);
+		int addrsz = gen_udp_address(s->protocol, &sa[i], ptr + 1);
+		ptr[0] = (uint8_t)addrsz;
+		ptr += 1 + addrsz;
+		memcpy(ptr, ss->udpbuffer[i], sz);
+		ptr += sz;
+	}
+	assert(ptr == data + total);
+
+	result->ud = count;
 	result->data = (char *)data;
 
-	return SOCKET_UDP;
+	return SOCKET_UDP_BATCH;
 }
 
 static int
@@ -1634,8 +2030,17 @@ static int
 report_accept(struct socket_server *ss, struct socket *s, struct socket_message *result) {
 	union sockaddr_all u;
 	socklen_t len = sizeof(u);
+#ifdef __linux__
+	int client_fd = accept4(s->fd, &u.s, &len, SOCK_NONBLOCK);
+#else
 	int client_fd = accept(s->fd, &u.s, &len);
+#endif
 	if (client_fd < 0) {
+		switch (errno) {
+		case AGAIN_WOULDBLOCK:
+			// accept queue is empty
+			return 0;
+		}
 		if (errno == EMFILE || errno == ENFILE) {
 			result->opaque = s->opaque;
 			result->id = s->id;
@@ -1651,21 +2056,27 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 				}
 				ss->reserve_fd = dup(1);
 			}
+			rearm_event(ss, s);
 			return -1;
 		} else {
+			rearm_event(ss, s);
 			return 0;
 		}
 	}
 	int id = reserve_id(ss);
 	if (id < 0) {
 		close(client_fd);
+		rearm_event(ss, s);
 		return 0;
 	}
 	socket_keepalive(client_fd);
+#ifndef __linux__
 	sp_nonblocking(client_fd);
+#endif
 	struct socket *ns = new_fd(ss, id, client_fd, PROTOCOL_TCP, s->opaque, false);
 	if (ns == NULL) {
 		close(client_fd);
+		rearm_event(ss, s);
 		return 0;
 	}
 	// accept new one connection
@@ -1702,10 +2113,28 @@ clear_closed_event(struct socket_server *ss, struct socket_message * result, int
 	}
 }
 
+// Dispatch the same event again to read/accept until EAGAIN, but no more than MAX_DRAIN times for fairness.
+static inline void
+drain_again(struct socket_server *ss, struct socket *s) {
+	if (++ss->drain_n < MAX_DRAIN) {
+		--ss->event_index;
+	} else {
+		ss->drain_n = 0;
+		rearm_event(ss, s);
+	}
+}
+
 // return type
 int 
 socket_server_poll(struct socket_server *ss, struct socket_message * result, int * more) {
 	for (;;) {
+		if (ss->broadcast) {
+			int type = broadcast_socket(ss, result);
+			if (type != -1) {
+				clear_closed_event(ss, result, type);
+				return type;
+			}
+		}
 		if (ss->checkctrl) {
 			if (has_cmd(ss)) {
 				int type = ctrl_cmd(ss, result);
@@ -1718,6 +2147,15 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 				ss->checkctrl = 0;
 			}
 		}
+#ifdef SP_EDGE_TRIGGER
+		if (ss->flush_n > 0) {
+			int type = flush_socket(ss, result);
+			if (type != -1) {
+				clear_closed_event(ss, result, type);
+				return type;
+			}
+		}
+#endif
 		if (ss->event_index == ss->event_n) {
 			ss->event_n = sp_wait(ss->event_fd, ss->ev, MAX_EVENT);
 			ss->checkctrl = 1;
@@ -1725,6 +2163,7 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 				*more = 0;
 			}
 			ss->event_index = 0;
+			ss->drain_n = 0;
 			if (ss->event_n <= 0) {
 				ss->event_n = 0;
 				int err = errno;
@@ -1743,13 +2182,25 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 		struct socket_lock l;
 		socket_lock_init(s, &l);
 		switch (ATOM_LOAD(&s->type)) {
-		case SOCKET_TYPE_CONNECTING:
-			return report_connect(ss, s, &l, result);
+		case SOCKET_TYPE_CONNECTING: {
+			int type = report_connect(ss, s, &l, result);
+#ifdef SP_EDGE_TRIGGER
+			if (type == SOCKET_OPEN) {
+				// the edge is consumed, dispatch the read/write flags of this event as a connected socket
+				--ss->event_index;
+			}
+#endif
+			return type;
+		}
 		case SOCKET_TYPE_LISTEN: {
 			int ok = report_accept(ss, s, result);
 			if (ok > 0) {
+				// drain the accept queue
+				drain_again(ss, s);
 				return SOCKET_ACCEPT;
-			} if (ok < 0 ) {
+			}
+			ss->drain_n = 0;
+			if (ok < 0 ) {
 				return SOCKET_ERR;
 			}
 			// when ok == 0, retry
@@ -1764,17 +2215,18 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 				if (s->protocol == PROTOCOL_TCP) {
 					type = forward_message_tcp(ss, s, &l, result);
 					if (type == SOCKET_MORE) {
-						--ss->event_index;
+						drain_again(ss, s);
 						return SOCKET_DATA;
 					}
 				} else {
 					type = forward_message_udp(ss, s, &l, result);
-					if (type == SOCKET_UDP) {
+					if (type == SOCKET_UDP || type == SOCKET_UDP_BATCH) {
 						// try read again
-						--ss->event_index;
-						return SOCKET_UDP;
+						drain_again(ss, s);
+						return type;
 					}
 				}
+				ss->drain_n = 0;
 				if (e->write && type != SOCKET_CLOSE && type != SOCKET_ERR) {
 					// Try to dispatch write message next step if write flag set.
 					e->read = false;
@@ -1870,7 +2322,7 @@ can_direct_write(struct socket *s, int id) {
 	return s->id == id && nomore_sending_data(s) && ATOM_LOAD(&s->type) == SOCKET_TYPE_CONNECTED && ATOM_LOAD(&s->udpconnecting) == 0;
 }
 
-// return -1 when error, 0 when success
+// return -1 when error, 0 when success, 1 when blocked (the send buffer is over the high watermark, See socket_server_flowcontrol)
 int 
 socket_server_send(struct socket_server *ss, struct socket_sendbuffer *buf) {
 	int id = buf->id;
@@ -1940,10 +2392,20 @@ socket_server_send(struct socket_server *ss, struct socket_sendbuffer *buf) {
 	request.u.send.buffer = clone_buffer(buf, &request.u.send.sz);
 
 	send_request(ss, &request, 'D', sizeof(request.u.send));
-	return 0;
+	// the requests in the pipe are not counted, so it may be a bit late
+	return ATOM_LOAD(&s->blocked) ? 1 : 0;
 }
 
-// return -1 when error, 0 when success
+// return 1 when the sends of id are blocked, until SOCKET_DRAIN
+int
+socket_server_blocked(struct socket_server *ss, int id) {
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (socket_invalid(s, id))
+		return 0;
+	return ATOM_LOAD(&s->blocked) ? 1 : 0;
+}
+
+// return -1 when error, 0 when success, 1 when blocked (See socket_server_send)
 int 
 socket_server_send_lowpriority(struct socket_server *ss, struct socket_sendbuffer *buf) {
 	int id = buf->id;
@@ -1961,7 +2423,42 @@ socket_server_send_lowpriority(struct socket_server *ss, struct socket_sendbuffe
 	request.u.send.buffer = clone_buffer(buf, &request.u.send.sz);
 
 	send_request(ss, &request, 'P', sizeof(request.u.send));
-	return 0;
+	return ATOM_LOAD(&s->blocked) ? 1 : 0;
+}
+
+// return the number of sockets the buffer is queued on
+int
+socket_server_send_shared(struct socket_server *ss, const int *ids, int n, struct socket_sendbuffer *buf) {
+	struct send_broadcast *b = MALLOC(sizeof(*b) + (n > 0 ? n-1 : 0) * sizeof(int));
+	int i;
+	int count = 0;
+	for (i=0;i<n;i++) {
+		int id = ids[i];
+		struct socket * s = &ss->slot[HASH_ID(id)];
+		if (socket_invalid(s, id) || s->closing)
+			continue;
+		inc_sending_ref(s, id);
+		b->id[count++] = id;
+	}
+	if (count == 0) {
+		FREE(b);
+		free_buffer(ss, buf);
+		return 0;
+	}
+	// the payload is cloned (RAWPOINTER) at most once, and shared by all the sockets.
+	struct shared_buffer *sb = MALLOC(sizeof(*sb));
+	size_t sz;
+	sb->ref = 1;
+	sb->origin = clone_buffer(buf, &sz);
+	send_object_init(ss, &sb->so, sb->origin, sz);
+	b->buffer = sb;
+	b->n = count;
+	b->index = 0;
+
+	struct request_package request;
+	request.u.broadcast.broadcast = b;
+	send_request(ss, &request, 'M', sizeof(request.u.broadcast));
+	return count;
 }
 
 void
@@ -1992,7 +2489,7 @@ socket_server_shutdown(struct socket_server *ss, uintptr_t opaque, int id) {
 // return -1 means failed
 // or return AF_INET or AF_INET6
 static int
-do_bind(const char *host, int port, int protocol, int *family) {
+do_bind(const char *host, int port, int protocol, int *family, bool reuseport) {
 	int fd;
 	int status;
 	int reuse = 1;
@@ -2025,6 +2522,15 @@ do_bind(const char *host, int port, int protocol, int *family) {
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(int))==-1) {
 		goto _failed;
 	}
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(int))==-1) {
+			goto _failed;
+		}
+#else
+		goto _failed;
+#endif
+	}
 	status = bind(fd, (struct sockaddr *)ai_list->ai_addr, ai_list->ai_addrlen);
 	if (status != 0)
 		goto _failed;
@@ -2039,9 +2545,9 @@ _failed_fd:
 }
 
 static int
-do_listen(const char * host, int port, int backlog) {
+do_listen(const char * host, int port, int backlog, bool reuseport) {
 	int family = 0;
-	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family);
+	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family, reuseport);
 	if (listen_fd < 0) {
 		return -1;
 	}
@@ -2049,12 +2555,14 @@ do_listen(const char * host, int port, int backlog) {
 		close(listen_fd);
 		return -1;
 	}
+	// accept in a loop until EAGAIN, see MAX_DRAIN
+	sp_nonblocking(listen_fd);
 	return listen_fd;
 }
 
-int 
-socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
-	int fd = do_listen(addr, port, backlog);
+static int
+listen_request(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog, bool reuseport) {
+	int fd = do_listen(addr, port, backlog, reuseport);
 	if (fd < 0) {
 		return -1;
 	}
@@ -2071,6 +2579,16 @@ socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * ad
 	return id;
 }
 
+int 
+socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+	return listen_request(ss, opaque, addr, port, backlog, false);
+}
+
+int
+socket_server_listen_reuseport(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+	return listen_request(ss, opaque, addr, port, backlog, true);
+}
+
 int
 socket_server_bind(struct socket_server *ss, uintptr_t opaque, int fd) {
 	struct request_package request;
@@ -2109,6 +2627,24 @@ socket_server_nodelay(struct socket_server *ss, int id) {
 	send_request(ss, &request, 'T', sizeof(request.u.setopt));
 }
 
+void
+socket_server_flowcontrol(struct socket_server *ss, int id, int64_t high, int64_t low, int droplow) {
+	struct request_package request;
+	request.u.flow.id = id;
+	request.u.flow.drop = droplow;
+	request.u.flow.high = high;
+	request.u.flow.low = low;
+	send_request(ss, &request, 'F', sizeof(request.u.flow));
+}
+
+void
+socket_server_udp_batch(struct socket_server *ss, int id, int enable) {
+	struct request_package request;
+	request.u.udpbatch.id = id;
+	request.u.udpbatch.enable = enable;
+	send_request(ss, &request, 'G', sizeof(request.u.udpbatch));
+}
+
 void 
 socket_server_userobject(struct socket_server *ss, struct socket_object_interface *soi) {
 	ss->soi = *soi;
@@ -2122,7 +2658,7 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	int family;
 	if (port != 0 || addr != NULL) {
 		// bind
-		fd = do_bind(addr, port, IPPROTO_UDP, &family);
+		fd = do_bind(addr, port, IPPROTO_UDP, &family, false);
 		if (fd < 0) {
 			return -1;
 		}
@@ -2159,7 +2695,7 @@ socket_server_udp_listen(struct socket_server *ss, uintptr_t opaque, const char*
 
 	int family;
 	// bind
-	fd = do_bind(addr, port, IPPROTO_UDP, &family);
+	fd = do_bind(addr, port, IPPROTO_UDP, &family, false);
 	if (fd < 0) {
 		return -1;
 	}
@@ -2426,6 +2962,8 @@ query_info(struct socket *s, struct socket_info *si) {
 	si->write = s->stat.write;
 	si->rtime = s->stat.rtime;
 	si->wtime = s->stat.wtime;
+	si->rcall = s->stat.rcall;
+	si->wcall = s->stat.wcall;
 	si->wbuffer = s->wb_size;
 	si->reading = s->reading;
 	si->writing = s->writing;
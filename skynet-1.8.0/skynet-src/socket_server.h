@@ -13,10 +13,19 @@
 #define SOCKET_EXIT 5
 #define SOCKET_UDP 6
 #define SOCKET_WARNING 7
+// only for the udp sockets set by socket_server_udp_batch. ud is the number of datagrams packed in data, each one is :
+//	uint32_t size; uint8_t addrsz; uint8_t udp_address[addrsz]; uint8_t payload[size];
+#define SOCKET_UDP_BATCH 8
+// the send buffer drains to the low watermark, See socket_server_flowcontrol
+#define SOCKET_DRAIN 9
 
 // Only for internal use
-#define SOCKET_RST 8
-#define SOCKET_MORE 9
+#define SOCKET_RST 10
+#define SOCKET_MORE 11
+
+// MAX_SOCKET will be 2^MAX_SOCKET_P, the live sockets never share a slot : id % MAX_SOCKET
+#define MAX_SOCKET_P 16
+#define MAX_SOCKET (1<<MAX_SOCKET_P)
 
 struct socket_server;
 
@@ -38,23 +47,35 @@ void socket_server_shutdown(struct socket_server *, uintptr_t opaque, int id);
 void socket_server_start(struct socket_server *, uintptr_t opaque, int id);
 void socket_server_pause(struct socket_server *, uintptr_t opaque, int id);
 
-// return -1 when error
+// return -1 when error, 1 when the send buffer is over the high watermark (the buffer is queued, wait for SOCKET_DRAIN)
 int socket_server_send(struct socket_server *, struct socket_sendbuffer *buffer);
 int socket_server_send_lowpriority(struct socket_server *, struct socket_sendbuffer *buffer);
+// send one buffer to n sockets (buffer->id is ignored), the buffer is shared rather than copied. return the number of sockets sent to
+int socket_server_send_shared(struct socket_server *, const int *ids, int n, struct socket_sendbuffer *buffer);
 
 // ctrl command below returns id
 int socket_server_listen(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
+// listen with SO_REUSEPORT, more than one listen socket (in different services, maybe) can bind the same port,
+// and the kernel balances the incoming connections among them.
+int socket_server_listen_reuseport(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
 int socket_server_connect(struct socket_server *, uintptr_t opaque, const char * addr, int port);
 int socket_server_bind(struct socket_server *, uintptr_t opaque, int fd);
 
 // for tcp
 void socket_server_nodelay(struct socket_server *, int id);
+// high > 0 : the sends return 1 when the send buffer reaches high bytes, and raise SOCKET_DRAIN when it drains to low bytes.
+// droplow : drop the low priority packages when the send buffer reaches high. high = 0 : disable.
+void socket_server_flowcontrol(struct socket_server *, int id, int64_t high, int64_t low, int droplow);
+int socket_server_blocked(struct socket_server *, int id);
 
 struct socket_udp_address;
 
 // create an udp socket handle, attach opaque with it . udp socket don't need call socket_server_start to recv message
 // if port != 0, bind the socket . if addr == NULL, bind ipv4 0.0.0.0 . If you want to use ipv6, addr can be "::" and port 0.
 int socket_server_udp(struct socket_server *, uintptr_t opaque, const char * addr, int port);
+// enable != 0 : read up to 16 datagrams by one syscall, and forward them as one SOCKET_UDP_BATCH message when more than one are read.
+// Disabled by default, every datagram is forwarded as SOCKET_UDP.
+void socket_server_udp_batch(struct socket_server *, int id, int enable);
 // set default dest address, return 0 when success
 int socket_server_udp_connect(struct socket_server *, int id, const char * addr, int port);
 
@@ -0,0 +1,61 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local N = 100
+local ROUND = 100
+local PORT = 8002
+
+skynet.start(function()
+	local clients = {}
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id, addr)
+		socket.start(id)
+		table.insert(clients, id)
+	end)
+
+	local conns = {}
+	for i = 1, N do
+		conns[i] = assert(socket.open("127.0.0.1", PORT))
+	end
+	while #clients < N do
+		skynet.sleep(1)
+	end
+
+	local payload = string.rep("x", 1000) .. "\n"
+	local done = 0
+	for i = 1, N do
+		skynet.fork(function()
+			for r = 1, ROUND do
+				local line = socket.readline(conns[i])
+				assert(line and #line == 1000, "broadcast lost")
+			end
+			done = done + 1
+		end)
+	end
+
+	local start = skynet.now()
+	for r = 1, ROUND do
+		assert(socket.broadcast(clients, payload) == N)
+	end
+	while done < N do
+		skynet.sleep(1)
+	end
+	print(string.format("broadcast %d bytes to %d sockets %d times : %d ticks", #payload, N, ROUND, skynet.now() - start))
+
+	-- closed sockets are skipped
+	socket.close(clients[1])
+	assert(socket.broadcast(clients, payload) == N - 1)
+	for i = 2, N do
+		assert(socket.readline(conns[i]))
+	end
+
+	for i = 1, N do
+		socket.close(conns[i])
+	end
+	for i = 2, N do
+		socket.close(clients[i])
+	end
+	socket.close(listen_id)
+	print("broadcast test ok")
+	skynet.exit()
+end)
@@ -0,0 +1,111 @@
+local skynet = require "skynet"
+
+local mode = ...
+local SERVICE = 100
+local N = 1000	-- fan-out
+local ROUND = 10
+
+if mode == "slave" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session, source, cmd, ti)
+		if cmd == "ping" then
+			skynet.retpack(skynet.self())
+		elseif cmd == "sleep" then
+			skynet.sleep(ti)
+			skynet.retpack(ti)
+		elseif cmd == "fail" then
+			error "fail"
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local slaves = {}
+	for i = 1, SERVICE do
+		slaves[i] = skynet.newservice(SERVICE_NAME, "slave")
+	end
+	local addrs = {}
+	for i = 1, N do
+		addrs[i] = slaves[(i-1) % SERVICE + 1]
+	end
+
+	local start = skynet.hpc()
+	for r = 1, ROUND do
+		local resp = {}
+		local co = coroutine.running()
+		local pending = N
+		for i = 1, N do
+			skynet.fork(function()
+				resp[i] = skynet.call(addrs[i], "lua", "ping")
+				pending = pending - 1
+				if pending == 0 then
+					skynet.wakeup(co)
+				end
+			end)
+		end
+		skynet.wait(co)
+		assert(resp[N] == addrs[N])
+	end
+	local fork_ti = skynet.hpc() - start
+
+	start = skynet.hpc()
+	for r = 1, ROUND do
+		local reqs = skynet.request()
+		for i = 1, N do
+			reqs:add { addrs[i], "lua", "ping" }
+		end
+		local count = 0
+		for req, resp in reqs:select() do
+			assert(resp[1] == req[1])
+			count = count + 1
+		end
+		assert(count == N)
+	end
+	local select_ti = skynet.hpc() - start
+
+	start = skynet.hpc()
+	for r = 1, ROUND do
+		local resp = skynet.callall(addrs, nil, "lua", "ping")
+		for i = 1, N do
+			assert(resp[i][1] == addrs[i])
+		end
+	end
+	local callall_ti = skynet.hpc() - start
+	print(string.format("%d-way fan-out %d times : fork %.2fms, select %.2fms, callall %.2fms",
+		N, ROUND, fork_ti / 1e6, select_ti / 1e6, callall_ti / 1e6))
+
+	-- failed requests and invalid addresses
+	local resp = skynet.callall({ slaves[1], slaves[2], 0xffffff }, nil, "lua", "fail")
+	assert(resp[1] == false and resp[2] == false and resp[3] == false)
+	-- timeout with partial results
+	local resp, timeout = skynet.callall({ slaves[1], slaves[2] }, 50, "lua", "sleep", 10)
+	assert(resp[1][1] == 10 and resp[2][1] == 10 and not timeout)
+	resp, timeout = skynet.callall({ slaves[1], slaves[2] }, 20, "lua", "sleep", 100)
+	assert(resp[1] == nil and resp[2] == nil and timeout)
+	skynet.sleep(100)	-- late responses are dropped
+	assert(#skynet.callall({}, nil, "lua", "ping") == 0)
+
+	-- kill the coroutines waiting in callall, by thread or by the name of thread
+	local function waiting()
+		local co = skynet.fork(function()
+			skynet.callall({ slaves[1], slaves[2] }, 500, "lua", "sleep", 50)
+			error "killed"
+		end)
+		skynet.yield()
+		return co
+	end
+	local co = waiting()
+	assert(skynet.killthread(co) == co and coroutine.status(co) == "dead")
+	co = waiting()
+	assert(skynet.killthread(tostring(co)) == co and coroutine.status(co) == "dead")
+	skynet.sleep(100)	-- the responses of the killed sessions are dropped
+	assert(skynet.task() == 0)
+
+	print("callall test ok")
+	skynet.exit()
+end)
+
+end
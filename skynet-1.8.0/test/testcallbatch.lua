@@ -0,0 +1,83 @@
+local skynet = require "skynet"
+
+local mode = ...
+local N = 500
+local ROUND = 20
+
+if mode == "slave" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session, source, cmd, k)
+		if cmd == "get" then
+			skynet.ret(skynet.pack(k * 2, "v" .. k))
+		elseif cmd == "sleep" then
+			skynet.sleep(k)
+			skynet.retpack(k)
+		elseif cmd == "response" then
+			local resp = skynet.response()
+			skynet.fork(function()
+				skynet.yield()
+				resp(true, k)
+			end)
+		elseif cmd == "fail" then
+			error("fail " .. k)
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local slave = skynet.newservice(SERVICE_NAME, "slave")
+	local requests = {}
+	for i = 1, N do
+		requests[i] = { "get", i }
+	end
+
+	local start = skynet.hpc()
+	for r = 1, ROUND do
+		for i = 1, N do
+			local v = skynet.call(slave, "lua", "get", i)
+			assert(v == i * 2)
+		end
+	end
+	local call_ti = skynet.hpc() - start
+
+	start = skynet.hpc()
+	for r = 1, ROUND do
+		local resp = skynet.callbatch(slave, "lua", requests)
+		for i = 1, N do
+			assert(resp[i][1] == i * 2 and resp[i][2] == "v" .. i and resp[i].n == 2)
+		end
+	end
+	local batch_ti = skynet.hpc() - start
+	print(string.format("%d requests %d times : call %.2fms, callbatch %.2fms", N, ROUND, call_ti / 1e6, batch_ti / 1e6))
+
+	-- per-item errors, suspended items and deferred responses
+	local resp = skynet.callbatch(slave, "lua", {
+		{ "sleep", 10 },
+		{ "fail", 2 },
+		{ "response", 3 },
+		{ "get", 4 },
+		{ "fail", 5 },
+	})
+	assert(resp[1][1] == 10 and resp[2] == false and resp[3][1] == 3 and resp[4][1] == 8 and resp[5] == false)
+	assert(#skynet.callbatch(slave, "lua", {}) == 0)
+	-- a malformed item gets an error response, the others still run
+	skynet.register_protocol {
+		name = "batch",
+		id = skynet.PTYPE_BATCH,
+	}
+	resp = skynet.unpack(skynet.rawcall(slave, "batch", skynet.pack(skynet.PTYPE_LUA, {
+		skynet.packstring("get", 1),
+		"\xff",
+		skynet.packstring("get", 3),
+	})))
+	assert(skynet.unpack(resp[1]) == 2 and resp[2] == false and skynet.unpack(resp[3]) == 6)
+	assert(not pcall(skynet.callbatch, 0xffffff, "lua", requests))
+
+	print("callbatch test ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,151 @@
+local skynet = require "skynet"
+local cluster = require "skynet.cluster"
+
+local mode = ...
+local WORKER = 100
+local N = 100	-- calls per worker
+
+if mode == "echo" then
+
+local pushed = 0
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session, source, cmd, ...)
+		if cmd == "echo" then
+			skynet.retpack(...)
+		elseif cmd == "push" then
+			pushed = pushed + 1
+		elseif cmd == "pushed" then
+			skynet.retpack(pushed)
+		elseif cmd == "sleep" then
+			skynet.sleep(...)
+			skynet.retpack(...)
+		end
+	end)
+end)
+
+else
+
+-- one process talks to itself through clustersender -> socket -> gate -> clusteragent
+local function bench(node)
+	local worker = WORKER
+	local co = coroutine.running()
+	local start = skynet.hpc()
+	for i = 1, WORKER do
+		skynet.fork(function()
+			for j = 1, N do
+				local v = cluster.call(node, "@echo", "echo", j)
+				assert(v == j)
+			end
+			worker = worker - 1
+			if worker == 0 then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+	local ti = (skynet.hpc() - start) / 1e9
+	return math.floor(WORKER * N / ti)
+end
+
+-- small calls while a large payload is on the way
+local function small_latency(node, large)
+	local done
+	skynet.fork(function()
+		assert(cluster.call(node, "@echo", "echo", large) == large)
+		done = true
+	end)
+	skynet.yield()
+	local start = skynet.hpc()
+	for i = 1, 10 do
+		assert(cluster.call(node, "@echo", "echo", i) == i)
+	end
+	local ti = (skynet.hpc() - start) / 1e6
+	while not done do
+		skynet.sleep(1)
+	end
+	return ti
+end
+
+skynet.start(function()
+	cluster.reload { self = "127.0.0.1:2531", lane = "127.0.0.1:2531" }
+	local echo = skynet.newservice(SERVICE_NAME, "echo")
+	cluster.register("echo", echo)
+	cluster.open "self"
+
+	local plain = bench "self"
+	cluster.reload { __batch = true }
+	local batch = bench "self"
+	print(string.format("cluster call %d x %d : plain %d req/s, batch %d req/s", WORKER, N, plain, batch))
+
+	-- large requests are not batched, pushes keep the order with requests
+	local large = string.rep("x", 100000)
+	assert(cluster.call("self", "@echo", "echo", large) == large)
+	for i = 1, 100 do
+		cluster.send("self", "@echo", "push")
+	end
+	assert(cluster.call("self", "@echo", "pushed") == 100)
+	cluster.reload { __batch = false }
+	assert(cluster.call("self", "@echo", "echo", 1) == 1)
+
+	-- node "lane" opens after the config, so it has 4 connections and a dedicated lane for large payload
+	cluster.reload { __connections = 4, __largepayload = 0x8000 }
+	local lanes = bench "lane"
+	local huge = string.rep("y", 8 * 1024 * 1024)
+	local single_ti = small_latency("self", huge)
+	local lane_ti = small_latency("lane", huge)
+	print(string.format("cluster call with 4 connections %d req/s, 10 small calls behind a large one : single %.2fms, lanes %.2fms",
+		lanes, single_ti, lane_ti))
+
+	-- compress the payload larger than 1K, a player snapshot like table is highly compressible
+	cluster.reload { __compress = 1024 }
+	local snapshot = {}
+	for i = 1, 20000 do
+		snapshot[i] = { id = i, name = "player" .. i, level = i % 100, items = { 1001, 1002, 1003 } }
+	end
+	local function check(v)
+		assert(#v == #snapshot and v[20000].name == "player20000" and v[1].items[3] == 1003)
+	end
+	check(cluster.call("self", "@echo", "echo", snapshot))	-- multi part even compressed
+	local small = cluster.call("self", "@echo", "echo", { table.unpack(snapshot, 1, 100) })	-- single package
+	assert(#small == 100 and small[100].name == "player100")
+	assert(cluster.call("self", "@echo", "echo", large) == large)
+	local random = {}
+	for i = 1, 1024 do
+		random[i] = string.char(math.random(0, 255))
+	end
+	random = table.concat(random)
+	assert(cluster.call("self", "@echo", "echo", random) == random)	-- incompressible
+	local nodes, agents = cluster.compressstat()
+	local stat = nodes.self
+	assert(stat.compress > 0 and stat.decompress > 0 and stat.skip > 0)
+	print(string.format("cluster compress : %d out, %d in, %d bytes saved, ratio %.3f, lz4 %.2fms",
+		stat.compress, stat.decompress, stat.saved, stat.ratio, stat.time * 1000))
+	for fd, stat in pairs(agents) do
+		if stat.compress > 0 then
+			assert(stat.decompress > 0)
+		end
+	end
+	cluster.reload { __compress = false }
+	check(cluster.call("self", "@echo", "echo", snapshot))
+
+	-- metrics and timeout
+	cluster.reload { __timeout = 50, __adaptive = true }
+	assert(cluster.call("self", "@echo", "sleep", 1) == 1)
+	assert(not pcall(cluster.call, "self", "@echo", "sleep", 200))
+	local stat = cluster.stat "self"
+	assert(stat.timeouts == 1 and stat.inflight == 1 and stat.timeout <= 50)
+	local n = 0
+	for _, v in ipairs(stat.rtt) do
+		n = n + v
+	end
+	assert(n == stat.requests - stat.inflight - stat.errors)
+	print(string.format("cluster stat self : %d requests, %d pushes, srtt %.2fms, timeout %d, %d bytes out, %d bytes in, %d connections",
+		stat.requests, stat.pushes, stat.srtt, stat.timeout, stat.bytes_out, stat.bytes_in, stat.connections))
+	cluster.reload { __timeout = false, __adaptive = false }
+
+	print("cluster test ok")
+	skynet.exit()
+end)
+
+end
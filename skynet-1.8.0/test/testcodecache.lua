@@ -0,0 +1,44 @@
+local skynet = require "skynet"
+local codecache = require "skynet.codecache"
+
+local mode = ...
+local N = 200
+
+if mode == "agent" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.ret()
+		skynet.exit()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local s1 = codecache.stat()
+	local start = skynet.now()
+	local agents = {}
+	local n = 0
+	for i = 1, N do
+		skynet.fork(function()
+			agents[i] = skynet.newservice(SERVICE_NAME, "agent")
+			n = n + 1
+		end)
+	end
+	while n < N do
+		skynet.sleep(1)
+	end
+	local ti = skynet.now() - start
+	for i = 1, N do
+		skynet.call(agents[i], "lua")
+	end
+	local s2 = codecache.stat()
+	print(string.format("spawn %d services in %d ticks, cache hit %d, miss %d, protos %d, bytes %d",
+		N, ti, s2.hit - s1.hit, s2.miss - s1.miss, s2.count, s2.bytes))
+	assert(s2.hit - s1.hit >= N)
+	print("codecache test ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,46 @@
+local skynet = require "skynet"
+
+local N = 1000
+
+skynet.start(function()
+	skynet.coroutine_pool(100, 200)
+	local stat = skynet.coroutine_pool()
+	assert(stat.size == 100 and stat.min == 100 and stat.max == 200)
+
+	-- a burst of forks
+	local function burst()
+		local done = 0
+		for i = 1, N do
+			skynet.fork(function()
+				skynet.yield()
+				done = done + 1
+			end)
+		end
+		while done < N do
+			skynet.yield()
+		end
+	end
+
+	local start = skynet.hpc()
+	burst()
+	local first = skynet.hpc() - start
+	collectgarbage()
+	stat = skynet.coroutine_pool()
+	assert(stat.size == 200, "pool is bounded by max")
+	local hit, miss = stat.hit, stat.miss
+
+	start = skynet.hpc()
+	burst()
+	local second = skynet.hpc() - start
+	stat = skynet.coroutine_pool()
+	print(string.format("burst %d forks : first %.2fms, after gc %.2fms, pool %d, hit %d, miss %d",
+		N, first / 1e6, second / 1e6, stat.size, stat.hit - hit, stat.miss - miss))
+	assert(stat.hit - hit >= 200)
+
+	assert(skynet.call(skynet.self(), "debug", "STAT").copool)
+
+	skynet.coroutine_pool(0, 10)
+	assert(skynet.coroutine_pool().size == 10)
+	print("coroutine pool test ok")
+	skynet.exit()
+end)
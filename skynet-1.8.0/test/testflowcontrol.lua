@@ -0,0 +1,88 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local PORT = 8004
+local HIGH = 1024 * 1024
+local LOW = 256 * 1024
+local CHUNK = string.rep("x", 64 * 1024)
+local N = 1024	-- 64M
+
+local function netstat(id)
+	for _, info in ipairs(socket.netstat()) do
+		if info.id == id then
+			return info
+		end
+	end
+end
+
+local function reader(client, total, done)
+	skynet.fork(function()
+		local n = 0
+		while n < total do
+			local s = assert(socket.read(client))
+			assert(not s:find("y", 1, true), "low priority package is not dropped")
+			n = n + #s
+		end
+		assert(n == total)
+		skynet.wakeup(done)
+	end)
+end
+
+skynet.start(function()
+	local server
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id, addr)
+		socket.start(id)
+		server = id
+	end)
+	-- the client doesn't read, the unread bytes > 128K pause it
+	local client = assert(socket.open("127.0.0.1", PORT))
+	while not server do
+		skynet.sleep(1)
+	end
+	socket.flowcontrol(server, HIGH, LOW, true)
+	-- not blocked, returns at once
+	assert(socket.drain(server))
+	assert(socket.drain(client))	-- no flow control
+
+	-- write until the send buffer reaches the high watermark
+	local total = 0
+	repeat
+		local ok, block = socket.write(server, CHUNK)
+		assert(ok)
+		total = total + #CHUNK
+		assert(total < 256 * 1024 * 1024, "never block")
+	until block
+	local wbuffer = netstat(server).wbuffer
+	assert(wbuffer >= HIGH)
+	-- dropped over the high watermark
+	for i = 1, 100 do
+		socket.lwrite(server, "y")
+	end
+
+	-- drain, and keep writing with the flow control
+	local done = coroutine.running()
+	local max = wbuffer
+	reader(client, total + N * #CHUNK, done)
+	assert(socket.drain(server))
+	for i = 1, N do
+		local ok, block = socket.write(server, CHUNK)
+		assert(ok)
+		if block then
+			local wb = netstat(server).wbuffer
+			if wb > max then
+				max = wb
+			end
+			assert(socket.drain(server))
+		end
+	end
+	skynet.wait(done)
+	assert(socket.drain(server))	-- drained already
+	print(string.format("write %dM, high %dK : max send buffer %dK", (total + N * #CHUNK) // (1024 * 1024), HIGH // 1024, max // 1024))
+
+	socket.close(client)
+	socket.close(server)
+	socket.close(listen_id)
+	print("flowcontrol test ok")
+	skynet.exit()
+end)
@@ -0,0 +1,191 @@
+local skynet = require "skynet"
+require "skynet.manager"
+local socket = require "skynet.socket"
+
+-- the service gate in C (service-src/service_gate.c), with a broker
+local N = 200000
+local PORT = 8887
+
+local mode = ...
+
+local function frame(s)
+	return string.pack(">s2", s)
+end
+
+local function varint(n)
+	local s = ""
+	repeat
+		local b = n & 0x7f
+		n = n >> 7
+		if n > 0 then
+			b = b | 0x80
+		end
+		s = s .. string.char(b)
+	until n == 0
+	return s
+end
+
+-- header "v,>2" : varint length, 2 bytes message id
+local function vframe(id, s)
+	local body = string.pack(">I2", id) .. s
+	return varint(#body) .. body
+end
+
+if mode == "broker" then
+
+local count = 0
+local bytes = 0
+local empty = 0
+local last
+local batch
+local waiting
+
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	unpack = skynet.tostring,
+	dispatch = function(fd, _, msg)
+		skynet.ignoreret()	-- session is fd
+		if batch then
+			-- frames with the headers, the empty frames are not skipped
+			local offset = 1
+			while offset <= #msg do
+				local s
+				s, offset = string.unpack(">s2", msg, offset)
+				if s == "" then
+					empty = empty + 1
+				else
+					last = s
+					count = count + 1
+					bytes = bytes + #s
+				end
+			end
+		else
+			last = msg
+			count = count + 1
+			bytes = bytes + #msg
+		end
+		if waiting and count >= waiting.n then
+			skynet.wakeup(waiting.co)
+		end
+	end
+}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, n)
+		if cmd == "batch" then
+			batch = n
+			count = 0
+			bytes = 0
+			empty = 0
+			skynet.retpack()
+		elseif cmd == "wait" then
+			if count < n then
+				waiting = { n = n, co = coroutine.running() }
+				skynet.wait(waiting.co)
+				waiting = nil
+			end
+			skynet.retpack(count, bytes, last, empty)
+		end
+	end)
+end)
+
+else
+
+local connected
+
+skynet.register_protocol {
+	name = "text",
+	id = skynet.PTYPE_TEXT,
+	pack = function(text) return text end,
+	unpack = skynet.tostring,
+	dispatch = function(_, source, msg)
+		local fd, cmd = msg:match "^(%d+) (%a+)"
+		if cmd == "open" then
+			skynet.send(source, "text", "start " .. fd)
+			connected = true
+		end
+	end
+}
+
+local function header_test(broker, port)
+	local gate = skynet.launch("gate", "v,>2", skynet.address(skynet.self()), "127.0.0.1:" .. port, skynet.PTYPE_CLIENT, 16)
+	skynet.send(gate, "text", "broker " .. broker)
+	skynet.call(broker, "lua", "batch")
+	local fd = socket.open("127.0.0.1", port)
+	while not connected do
+		skynet.sleep(1)
+	end
+	connected = false
+
+	-- the id field is forwarded with the payload
+	local large = string.rep("x", 60000)
+	local f = vframe(1, "hello") .. vframe(2, "") .. vframe(3, large)
+	for i = 1, #f, 7 do
+		socket.write(fd, f:sub(i, i + 6))
+		skynet.yield()
+	end
+	socket.write(fd, vframe(4, "a") .. vframe(5, "bc"))
+	local count, bytes, last = skynet.call(broker, "lua", "wait", 5)
+	assert(count == 5 and bytes == 2 * 5 + 5 + #large + 3 and last == string.pack(">I2", 5) .. "bc")
+	socket.close(fd)
+	skynet.kill(gate)
+end
+
+local function run(broker, port, batch)
+	local gate = skynet.launch("gate", "S", skynet.address(skynet.self()), "127.0.0.1:" .. port, skynet.PTYPE_CLIENT, 16, batch and "batch" or nil)
+	skynet.send(gate, "text", "broker " .. broker)
+	skynet.call(broker, "lua", "batch", batch)
+	local fd = socket.open("127.0.0.1", port)
+	while not connected do
+		skynet.sleep(1)
+	end
+	connected = false
+
+	-- a frame split into several writes, an empty frame, and a large one
+	local large = string.rep("x", 60000)
+	local f = frame "hello" .. frame "" .. frame(large)
+	for i = 1, #f, 7 do
+		socket.write(fd, f:sub(i, i + 6))
+		skynet.yield()
+	end
+	local count, bytes, last, empty = skynet.call(broker, "lua", "wait", 2)
+	assert(count == 2 and bytes == 5 + #large and last == large)
+	local base = 2
+	if batch then
+		-- the empty frames are forwarded in batch mode, the header split into two reads too
+		socket.write(fd, "\0")
+		skynet.sleep(1)
+		socket.write(fd, "\0" .. frame "z")
+		count, bytes, last, empty = skynet.call(broker, "lua", "wait", 3)
+		assert(last == "z" and empty == 2)
+		base = 3
+	end
+
+	-- many small frames in each read
+	local msg = frame(string.rep("y", 16))
+	local chunk = string.rep(msg, 1000)
+	local start = skynet.hpc()
+	for i = 1, N // 1000 do
+		socket.write(fd, chunk)
+	end
+	count, bytes, last = skynet.call(broker, "lua", "wait", N + base)
+	assert(count == N + base and last == string.rep("y", 16))
+	local ti = (skynet.hpc() - start) / 1e9
+	socket.close(fd)
+	skynet.kill(gate)
+	return math.floor(N / ti)
+end
+
+skynet.start(function()
+	local broker = skynet.newservice(SERVICE_NAME, "broker")
+	skynet.name(".gatebroker", broker)
+	local plain = run(".gatebroker", PORT)
+	local batch = run(".gatebroker", PORT + 1, true)
+	header_test(".gatebroker", PORT + 2)
+	print(string.format("gate %d frames : plain %d frames/s, batch %d frames/s", N, plain, batch))
+	print("gate test ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,282 @@
+local skynet = require "skynet"
+require "skynet.manager"
+
+-- service/gate.lua (snax.gateserver), the packages of a forwarded fd are routed to the agent by netpack
+local N = 200000
+local PORT = 8897
+
+local mode = ...
+
+local function frame(s)
+	return string.pack(">s2", s)
+end
+
+local function varint(n)
+	local s = ""
+	repeat
+		local b = n & 0x7f
+		n = n >> 7
+		if n > 0 then
+			b = b | 0x80
+		end
+		s = s .. string.char(b)
+	until n == 0
+	return s
+end
+
+-- header "v,<2" : varint length, 2 bytes message id
+local function vframe(id, s)
+	local body = string.pack("<I2", id) .. s
+	return varint(#body) .. body
+end
+
+if mode == "agent" then
+
+local count = 0
+local bytes = 0
+local last
+local waiting
+local log = {}	-- the short packages in order
+
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	unpack = skynet.tostring,
+	dispatch = function(fd, _, msg)
+		skynet.ignoreret()	-- session is fd
+		last = msg
+		if #msg < 8 then
+			table.insert(log, msg)
+		end
+		count = count + 1
+		bytes = bytes + #msg
+		if waiting and count >= waiting.n then
+			skynet.wakeup(waiting.co)
+		end
+	end
+}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, n)
+		if cmd == "wait" then
+			if count < n then
+				waiting = { n = n, co = coroutine.running() }
+				skynet.wait(waiting.co)
+				waiting = nil
+			end
+			skynet.retpack(count, bytes, last)
+		elseif cmd == "log" then
+			skynet.retpack(log)
+		end
+	end)
+end)
+
+elseif mode == "routegate" then
+
+-- a gateserver sets the route in handler.message, when the packages after it in the same read are still queued
+local gateserver = require "snax.gateserver"
+local netpack = require "skynet.netpack"
+
+local watchdog
+local agent
+local recv = {}
+local handler = {}
+
+function handler.open(source, conf)
+	watchdog = conf.watchdog
+	agent = conf.agent
+end
+
+function handler.connect(fd)
+	skynet.send(watchdog, "lua", "socket", "open", fd)
+end
+
+function handler.message(fd, msg, sz)
+	local s = netpack.tostring(msg, sz)
+	table.insert(recv, s)
+	if s == "route" then
+		gateserver.route(fd, agent)
+	end
+end
+
+function handler.command(cmd, source, fd)
+	if cmd == "accept" then
+		gateserver.openclient(fd)
+	elseif cmd == "recv" then
+		return recv
+	end
+end
+
+gateserver.start(handler)
+
+else
+
+local socket = require "skynet.socket"	-- the gateserver above registers the socket protocol itself
+
+local gate
+local agent
+local connected	-- the fd in gate
+local forward
+local recv = {}	-- watchdog recv { id, msg }
+local waiting
+
+local function connect(port)
+	local fd = socket.open("127.0.0.1", port)
+	while not connected do
+		skynet.sleep(1)
+	end
+	local gate_fd = connected
+	connected = nil
+	return fd, gate_fd
+end
+
+local function route_test()
+	forward = true
+	gate = skynet.newservice "gate"
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = PORT, watchdog = skynet.self() })
+	local fd = connect(PORT)
+
+	-- a package split into several writes, an empty package, and a large one
+	local large = string.rep("x", 60000)
+	local f = frame "hello" .. frame "" .. frame(large)
+	for i = 1, #f, 7 do
+		socket.write(fd, f:sub(i, i + 6))
+		skynet.yield()
+	end
+	local count, bytes, last = skynet.call(agent, "lua", "wait", 3)
+	assert(count == 3 and bytes == 5 + #large and last == large)
+
+	-- many small packages in each read
+	local msg = frame(string.rep("y", 16))
+	local chunk = string.rep(msg, 1000)
+	local start = skynet.hpc()
+	for i = 1, N // 1000 do
+		socket.write(fd, chunk)
+	end
+	count, bytes, last = skynet.call(agent, "lua", "wait", N + 3)
+	assert(count == N + 3 and last == string.rep("y", 16))
+	local ti = (skynet.hpc() - start) / 1e9
+	print(string.format("gateserver %d packages : %d packages/s", N, math.floor(N / ti)))
+	socket.close(fd)
+	skynet.call(gate, "lua", "close")
+end
+
+local function wait_recv(n)
+	while #recv < n do
+		waiting = coroutine.running()
+		skynet.wait(waiting)
+	end
+end
+
+local function header_test()
+	forward = false
+	gate = skynet.newservice "gate"
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = PORT + 1, watchdog = skynet.self(), header = "v,<2" })
+	local fd, gate_fd = connect(PORT + 1)
+
+	-- the header split byte by byte
+	local large = string.rep("x", 60000)
+	local f = vframe(1, "hello") .. vframe(2, "") .. vframe(3, large)
+	for i = 1, 8 do
+		socket.write(fd, f:sub(i, i))
+		skynet.yield()
+	end
+	for i = 9, #f, 1000 do
+		socket.write(fd, f:sub(i, i + 999))
+		skynet.yield()
+	end
+	-- many packages in one read
+	f = {}
+	for i = 1, 100 do
+		f[i] = vframe(1000 + i, tostring(i))
+	end
+	socket.write(fd, table.concat(f))
+	wait_recv(103)
+	assert(recv[1][1] == 1 and recv[1][2] == "hello")
+	assert(recv[2][1] == 2 and recv[2][2] == "")
+	assert(recv[3][1] == 3 and recv[3][2] == large)
+	for i = 1, 100 do
+		local r = recv[3 + i]
+		assert(r[1] == 1000 + i and r[2] == tostring(i))
+	end
+
+	-- the routed agent gets the id field before the payload
+	skynet.call(gate, "lua", "forward", gate_fd, 0, agent)
+	local base = skynet.call(agent, "lua", "wait", 0)
+	socket.write(fd, vframe(7, "world"))
+	local _, _, last = skynet.call(agent, "lua", "wait", base + 1)
+	assert(last == string.pack("<I2", 7) .. "world")
+
+	-- the agent not routed (an unknown name when forward) gets the same package
+	skynet.call(gate, "lua", "forward", gate_fd, 0, ".gsagent")
+	skynet.name(".gsagent", agent)
+	socket.write(fd, vframe(8, "lua"))
+	_, _, last = skynet.call(agent, "lua", "wait", base + 2)
+	assert(last == string.pack("<I2", 8) .. "lua")
+
+	-- invalid varint
+	socket.write(fd, "\xff\xff\xff\xff\xff\xff")
+	wait_recv(104)
+	assert(recv[104][1] == "error")
+	socket.close(fd)
+	skynet.call(gate, "lua", "close")
+end
+
+local function flush_test()
+	forward = false
+	gate = skynet.newservice(SERVICE_NAME, "routegate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = PORT + 2, watchdog = skynet.self(), agent = agent })
+	local fd = connect(PORT + 2)
+	local base = skynet.call(agent, "lua", "wait", 0)
+	local log = skynet.call(agent, "lua", "log")
+
+	-- the queued packages after "route" are sent to the agent before the later ones
+	local f = { frame "a", frame "route" }
+	for i = 1, 10 do
+		f[#f+1] = frame(tostring(i))
+	end
+	socket.write(fd, table.concat(f))
+	socket.write(fd, frame "11")
+	skynet.call(agent, "lua", "wait", base + 11)
+	local recv = skynet.call(gate, "lua", "recv")
+	assert(#recv == 2 and recv[1] == "a" and recv[2] == "route")
+	local newlog = skynet.call(agent, "lua", "log")
+	for i = 1, 11 do
+		assert(newlog[#log + i] == tostring(i))
+	end
+	socket.close(fd)
+	skynet.call(gate, "lua", "close")
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, subcmd, fd, msg, id)
+		-- watchdog
+		if cmd == "socket" then
+			if subcmd == "open" then
+				if forward then
+					skynet.call(gate, "lua", "forward", fd, 0, agent)
+				else
+					skynet.call(gate, "lua", "accept", fd)
+				end
+				connected = fd
+			elseif subcmd == "data" then
+				table.insert(recv, { id, msg })
+			elseif subcmd == "error" then
+				table.insert(recv, { "error", msg })
+			end
+			if waiting then
+				local co = waiting
+				waiting = nil
+				skynet.wakeup(co)
+			end
+		end
+	end)
+	agent = skynet.newservice(SERVICE_NAME, "agent")
+	route_test()
+	header_test()
+	flush_test()
+	print("gateserver test ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,86 @@
+local skynet = require "skynet"
+local profile = require "skynet.profile"
+
+local mode, gcmode = ...
+local N = 20000
+
+if mode == "worker" then
+
+if gcmode == "idle" then
+	skynet.gcidle(200, 100)
+elseif gcmode == "bad" then
+	skynet.gcidle("x", 1.5)	-- fallback to the default values
+end
+
+skynet.start(function()
+	local cache = {}
+	skynet.dispatch("lua", function(_,_, cmd, i)
+		if cmd == "stat" then
+			skynet.ret(skynet.pack(profile.gcstat(), collectgarbage "count"))
+			return
+		elseif cmd == "burst" then
+			-- the live objects make a long cycle, and each message makes about 5M garbage
+			if not cache.live then
+				local live = {}
+				for j = 1, 100000 do
+					live[j] = { j }
+				end
+				cache.live = live
+			end
+			for j = 1, 100000 do
+				local t = { j }
+			end
+			return
+		end
+		-- make some garbage
+		local t = {}
+		for j = 1, 100 do
+			t[j] = { j, tostring(j) }
+		end
+		cache[i % 100] = t
+		skynet.ret()
+	end)
+end)
+
+else
+
+local function run(gcmode)
+	local worker = skynet.newservice(SERVICE_NAME, "worker", gcmode)
+	local max = 0
+	local start = skynet.hpc()
+	for i = 1, N do
+		local t = skynet.hpc()
+		skynet.call(worker, "lua", "work", i)
+		t = skynet.hpc() - t
+		if t > max then
+			max = t
+		end
+	end
+	local avg = (skynet.hpc() - start) / N
+	local gc, mem = skynet.call(worker, "lua", "stat")
+	return avg / 1000, max / 1000, gc, mem
+end
+
+skynet.start(function()
+	local avg, max, gc, mem = run "default"
+	assert(gc == nil)
+	print(string.format("default : call avg %.1fus, max %.1fus, mem %.0fK", avg, max, mem))
+	avg, max, gc, mem = run "idle"
+	assert(gc and gc.cycles > 0)
+	print(string.format("gcidle  : call avg %.1fus, max %.1fus, mem %.0fK, gc steps %d, cycles %d, time %.3fs",
+		avg, max, mem, gc.steps, gc.cycles, gc.time))
+	-- the steps pay for the allocation, the memory is bounded when the service is busy
+	local worker = skynet.newservice(SERVICE_NAME, "worker", "idle")
+	for i = 1, 100 do
+		skynet.send(worker, "lua", "burst")
+	end
+	gc, mem = skynet.call(worker, "lua", "stat")
+	print(string.format("burst   : mem %.0fK, gc steps %d, cycles %d", mem, gc.steps, gc.cycles))
+	assert(mem < 32 * 1024)
+	avg, max, gc, mem = run "bad"
+	assert(gc and gc.cycles > 0)
+	print("gcidle test ok")
+	skynet.exit()
+end)
+
+end
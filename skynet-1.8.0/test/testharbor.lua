@@ -0,0 +1,72 @@
+local skynet = require "skynet"
+local harbor = require "skynet.harbor"
+
+-- harbor throughput, run two nodes :
+--	harbor = 1, standalone = "0.0.0.0:2013", address = "127.0.0.1:2526", master = "127.0.0.1:2013" : the sink
+--	harbor = 2, address = "127.0.0.1:2527", master = "127.0.0.1:2013" : the benchmark
+local mode = ...
+local N = 100000
+local WORKER = 100
+
+if mode == "sink" then
+
+local count = 0
+
+skynet.start(function()
+	skynet.dispatch("lua", function(session, source, cmd, data)
+		if cmd == "push" then
+			count = count + 1
+		elseif cmd == "count" then
+			skynet.retpack(count)
+		elseif cmd == "echo" then
+			skynet.retpack(data)
+		end
+	end)
+	harbor.globalname "HARBORSINK"
+end)
+
+else
+
+local function push(sink, data)
+	local base = skynet.call(sink, "lua", "count")
+	local start = skynet.hpc()
+	for i = 1, N do
+		skynet.send(sink, "lua", "push", data)
+	end
+	-- the messages from one service keep the order, so the call returns after all the pushes
+	assert(skynet.call(sink, "lua", "count") == base + N)
+	return math.floor(N / ((skynet.hpc() - start) / 1e9))
+end
+
+local function call(sink)
+	local worker = WORKER
+	local co = coroutine.running()
+	local start = skynet.hpc()
+	for i = 1, WORKER do
+		skynet.fork(function()
+			for j = 1, N // WORKER do
+				assert(skynet.call(sink, "lua", "echo", j) == j)
+			end
+			worker = worker - 1
+			if worker == 0 then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+	return math.floor(N / ((skynet.hpc() - start) / 1e9))
+end
+
+skynet.start(function()
+	if skynet.getenv "harbor" == "1" then
+		skynet.newservice(SERVICE_NAME, "sink")
+		return
+	end
+	local sink = harbor.queryname "HARBORSINK"
+	print(string.format("harbor push %d : 16 bytes %d msg/s, 1K bytes %d msg/s",
+		N, push(sink, string.rep("x", 16)), push(sink, string.rep("x", 1024))))
+	print(string.format("harbor call %d x %d : %d req/s", WORKER, N // WORKER, call(sink)))
+	print("harbor test ok")
+end)
+
+end
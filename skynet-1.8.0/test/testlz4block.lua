@@ -0,0 +1,116 @@
+local skynet = require "skynet"
+local core = require "skynet.cluster.core"
+
+-- the lz4 block codec (lualib-src/lz4block.c) used by the compressed cluster messages
+
+local compressor = core.compressor(64)
+
+-- returns the request package without the WORD header
+local function compress(data)
+	local msg, sz = skynet.pack(data)
+	local req = core.packrequest(1, 1, msg, sz, compressor)
+	return skynet.tostring(req, #req):sub(3)
+end
+
+local function decode(req)
+	local addr, session, msg, sz = core.unpackrequest(req, nil, nil, compressor)
+	local str = skynet.tostring(msg, sz)
+	skynet.trash(msg, sz)
+	return str
+end
+
+-- a small request to address 1, session 1, compressed payload : DWORD size + lz4 block
+local function request(size, block)
+	return string.pack("<BI4I4I4", 0x20, 1, 1, size) .. block
+end
+
+skynet.start(function()
+	local t = {}
+	for i = 1, 200 do
+		t[i] = { id = i, name = "player" .. i }
+	end
+	local req = compress(t)
+	assert(req:byte() & 0x20 ~= 0)
+	local raw = skynet.packstring(t)
+	assert(#req < #raw)
+	assert(decode(req) == raw)
+
+	-- overlapped matches (offset < match length) and long literal runs
+	local s = string.rep("a", 1000) .. string.rep("xy", 500)
+	for i = 1, 300 do
+		s = s .. string.char(i * 37 % 256)
+	end
+	assert(decode(compress(s)) == skynet.packstring(s))
+
+	-- a block ends with the literals
+	assert(decode(request(4, "\x40abcd")) == "abcd")
+
+	-- malformed blocks are rejected
+	local bad = {
+		request(10, ""),	-- no block
+		request(10, "\xa0abc"),	-- the literals are truncated
+		request(10, "\xf0\xff"),	-- the literal length is truncated
+		request(4, "\x10a\x00\x00"),	-- offset 0
+		request(8, "\x10a\x02\x00"),	-- offset out of the output
+		request(8, "\x10a\x01"),	-- the offset is truncated
+		request(8, "\x1fa\x01\x00"),	-- the match length is truncated
+		request(2, "\x40abcd"),	-- the output is larger than the size
+		request(0x7fffffff, "\x40abcd"),	-- the size is too large
+		request(100, "\x40abcd"),	-- the output is shorter than the size
+	}
+	for i, r in ipairs(bad) do
+		assert(not pcall(decode, r), i)
+	end
+
+	-- a batch fails as a whole, the payloads unpacked before the bad package are freed
+	local function batch(...)
+		local b = {}
+		for i, r in ipairs {...} do
+			b[i] = string.pack(">s2", r)
+		end
+		return "\x05" .. table.concat(b)
+	end
+	local packages = core.unpackrequest(batch(req, request(4, "\x40abcd")), nil, nil, compressor)
+	assert(#packages == 2 and packages[2].n == 4)
+	for _, p in ipairs(packages) do
+		skynet.trash(p[3], p[4])
+	end
+	assert(not pcall(core.unpackrequest, batch(req, request(100, "\x40abcd")), nil, nil, compressor))
+	assert(not pcall(core.unpackrequest, batch(req, "\x00\x01"), nil, nil, compressor))	-- short package
+	assert(not pcall(core.unpackrequest, batch(req, "\x7f"), nil, nil, compressor))	-- bad type
+	assert(not pcall(core.unpackrequest, batch(req) .. "\x00", nil, nil, compressor))	-- short frame
+
+	-- the buffer owned by unpackrequest (from gate) is freed when the package is invalid
+	local function own(pkg)
+		local msg, sz = core.concat { #pkg, pkg }
+		return core.unpackrequest(msg, sz, true, compressor)
+	end
+	local addr, session, msg, sz = own(req)
+	assert(addr == 1 and session == 1 and skynet.tostring(msg, sz) == raw)
+	skynet.trash(msg, sz)
+	for _, pkg in ipairs {
+		"\x00\x01\x02",	-- short request
+		"\x01\x01\x02",	-- short multi part header
+		"\x7f",	-- unknown type
+		request(100, "\x40abcd"),	-- failed decompress
+		batch(req, "\x7f"),
+	} do
+		assert(not pcall(own, pkg))
+	end
+
+	-- random corruption never reads or writes out of the buffers
+	local n = 0
+	for i = 1, 2000 do
+		local pos = math.random(14, #req)
+		local c = req:sub(1, pos - 1) .. string.char(math.random(0, 255)) .. req:sub(pos + 1)
+		if math.random(4) == 1 then
+			c = c:sub(1, math.random(13, #c))
+		end
+		if not pcall(decode, c) then
+			n = n + 1
+		end
+	end
+	print(string.format("lz4 block : %d -> %d bytes, %d of 2000 corrupted blocks rejected", #raw, #req - 13, n))
+	print("lz4block test ok")
+	skynet.exit()
+end)
@@ -0,0 +1,64 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local mode = ...
+local PORT = 8004
+
+if mode == "listener" then
+
+local accepted = 0
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", PORT, 1024, true)
+	socket.start(id, function(fd, addr)
+		accepted = accepted + 1
+		socket.close_fd(fd)
+	end)
+	skynet.dispatch("lua", function()
+		skynet.ret(skynet.pack(accepted))
+	end)
+end)
+
+else
+
+local LISTENER = 4
+local CONNECTOR = 50
+local N = 5000
+
+skynet.start(function()
+	local listeners = {}
+	for i = 1, LISTENER do
+		listeners[i] = skynet.newservice(SERVICE_NAME, "listener")
+	end
+
+	local task = N // CONNECTOR
+	local worker = CONNECTOR
+	local start = skynet.now()
+	for i = 1, CONNECTOR do
+		skynet.fork(function()
+			for j = 1, task do
+				local fd = socket.open("127.0.0.1", PORT)
+				if fd then
+					socket.close(fd)
+				end
+			end
+			worker = worker - 1
+		end)
+	end
+	while worker > 0 do
+		skynet.sleep(1)
+	end
+	local ti = skynet.now() - start
+	print(string.format("%d connections in %d ticks, rate = %d/s", N, ti, ti > 0 and N * 100 // ti or N * 100))
+
+	local total = 0
+	for i, addr in ipairs(listeners) do
+		local n = skynet.call(addr, "lua")
+		print(string.format("listener %d accepted %d", i, n))
+		total = total + n
+	end
+	assert(total > 0)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,130 @@
+local skynet = require "skynet"
+
+local COUNT = 2000000	-- bytes packed per shape
+
+local function deepcompare(a, b)
+	if type(a) ~= "table" or type(b) ~= "table" then
+		return a == b
+	end
+	for k,v in pairs(a) do
+		if not deepcompare(v, b[k]) then
+			return false
+		end
+	end
+	for k in pairs(b) do
+		if a[k] == nil then
+			return false
+		end
+	end
+	return true
+end
+
+local function array(n, f)
+	local t = {}
+	for i = 1, n do
+		t[i] = f(i)
+	end
+	return t
+end
+
+local shapes = {
+	{ "call args", { "get", 1001, true } },
+	{ "player", { {
+		id = 10001,
+		name = "player_10001",
+		level = 65,
+		exp = 1234567890123,
+		pos = { x = 1.5, y = -20.25, z = 0 },
+		items = array(40, function(i) return { id = i, count = i * 3, bind = i % 2 == 0 } end),
+		buffs = { [101] = 30, [102] = 60, [205] = 3600 },
+	} } },
+	{ "int array", { array(10000, function(i) return i * 7 end) } },
+	{ "tile map", { array(10000, function(i) return i % 100 end) } },
+	{ "real array", { array(10000, function(i) return i / 8 end) } },
+	{ "array+hash", { (function()
+		local t = array(1000, function(i) return i * 100000 end)
+		t.version = 3
+		t[-1] = math.mininteger
+		return t
+	end)() } },
+	{ "string list", { array(200, function(i) return string.rep("s", i % 64) end) } },
+	{ "nested", { (function()
+		local t = { v = 0 }
+		for i = 1, 30 do
+			t = { v = i, next = t }
+		end
+		return t
+	end)() } },
+}
+
+local function bench(name, pack, args, N)
+	local start = skynet.hpc()
+	local msg, sz
+	for i = 1, N do
+		msg, sz = pack(table.unpack(args))
+		skynet.trash(msg, sz)
+	end
+	local pack_ti = skynet.hpc() - start
+	msg, sz = pack(table.unpack(args))
+	start = skynet.hpc()
+	for i = 1, N do
+		skynet.unpack(msg, sz)
+	end
+	local unpack_ti = skynet.hpc() - start
+	local r = table.pack(skynet.unpack(msg, sz))
+	skynet.trash(msg, sz)
+	assert(r.n == #args)
+	for i = 1, #args do
+		assert(deepcompare(args[i], r[i]), name)
+	end
+	return sz, pack_ti / N, unpack_ti / N
+end
+
+skynet.start(function()
+	for _, shape in ipairs(shapes) do
+		local name, args = shape[1], shape[2]
+		local N = COUNT // #skynet.packstring(table.unpack(args))
+		local sz, pack_ti, unpack_ti = bench(name, skynet.pack, args, N)
+		local _, hint_ti = bench(name, function(...) return skynet.packhint(sz, ...) end, args, N)
+		local _, est_ti = bench(name, skynet.packestimate, args, N)
+		print(string.format("%-12s size=%-6d pack=%.0fns packhint=%.0fns packestimate=%.0fns unpack=%.0fns",
+			name, sz, pack_ti, hint_ti, est_ti, unpack_ti))
+	end
+
+	-- mixed arrays are not packed
+	local mixed = array(100, function(i) return i end)
+	mixed[50] = 50.0
+	mixed[51] = "51"
+	local r = skynet.unpack(skynet.packstring(mixed))
+	assert(math.type(r[50]) == "float" and r[51] == "51" and r[100] == 100)
+	local ints = skynet.packstring(array(100, function(i) return i end))
+	if skynet.getenv "packarray" == "true" then
+		assert(#ints < 110)
+	else
+		-- the old format by default
+		assert(#ints > 200)
+	end
+	assert(not pcall(skynet.unpack, ints:sub(1, 50)))
+
+	-- the same error as pack
+	local deep = {}
+	local t = deep
+	for i = 1, 40 do
+		t.next = {}
+		t = t.next
+	end
+	assert(not pcall(skynet.packestimate, deep))
+	assert(not pcall(skynet.packhint, 16, deep))
+	assert(not pcall(skynet.packestimate, print))
+	-- stops at the max depth, doesn't walk every path of a recursive table
+	local r = {}
+	r[1] = r
+	r[2] = r
+	local start = skynet.hpc()
+	local ok, err = pcall(skynet.packestimate, r)
+	assert(not ok and err:find "too depth")
+	assert(skynet.hpc() - start < 1e9)
+	assert(not pcall(skynet.pack, r))
+	print("seri test ok")
+	skynet.exit()
+end)
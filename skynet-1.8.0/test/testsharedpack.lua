@@ -0,0 +1,91 @@
+local skynet = require "skynet"
+
+local mode = ...
+local N = 50
+local ROUND = 20
+
+if mode == "receiver" then
+
+skynet.start(function()
+	local count = 0
+	skynet.dispatch("lua", function(session, source, cmd, t)
+		if cmd == "push" then
+			assert(#t.tiles == 10000 and t.tiles[10000] == 10000)
+			count = count + 1
+		elseif cmd == "query" then
+			skynet.ret(skynet.pack(count))
+		end
+	end)
+end)
+
+elseif mode == "proxy" then
+
+require "skynet.manager"	-- inject skynet.forward_type
+
+local target = tonumber((select(2, ...)))
+
+skynet.register_protocol {
+	name = "system",
+	id = skynet.PTYPE_SYSTEM,
+	unpack = function (...) return ... end,
+}
+
+-- forward mode reserves the message, it's redirected without a copy
+skynet.forward_type({ [skynet.PTYPE_LUA] = skynet.PTYPE_SYSTEM }, function()
+	skynet.dispatch("system", function (session, source, msg, sz)
+		skynet.ignoreret()	-- the target responds to the source
+		skynet.redirect(target, source, "lua", session, msg, sz)
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local receivers = {}
+	for i = 1, N do
+		receivers[i] = skynet.newservice(SERVICE_NAME, "receiver")
+	end
+	local tiles = {}
+	for i = 1, 10000 do
+		tiles[i] = i
+	end
+	local snapshot = { tiles = tiles, name = "scene" }
+
+	local start = skynet.hpc()
+	for r = 1, ROUND do
+		for _, addr in ipairs(receivers) do
+			skynet.send(addr, "lua", "push", snapshot)
+		end
+	end
+	local copy_ti = skynet.hpc() - start
+
+	start = skynet.hpc()
+	for r = 1, ROUND do
+		local obj = skynet.sharedpack("push", snapshot)
+		for _, addr in ipairs(receivers) do
+			skynet.rawsend(addr, "lua", obj)
+		end
+	end
+	local shared_ti = skynet.hpc() - start
+
+	for _, addr in ipairs(receivers) do
+		assert(skynet.call(addr, "lua", "query") == ROUND * 2)
+	end
+	-- rawcall with a shared request
+	assert(skynet.unpack(skynet.rawcall(receivers[1], "lua", skynet.sharedpack("query"))) == ROUND * 2)
+	-- a forward_type service redirects the shared messages
+	local proxy = skynet.newservice(SERVICE_NAME, "proxy", receivers[2])
+	for r = 1, ROUND do
+		skynet.rawsend(proxy, "lua", skynet.sharedpack("push", snapshot))
+	end
+	assert(skynet.unpack(skynet.rawcall(proxy, "lua", skynet.sharedpack("query"))) == ROUND * 3)
+	-- send to an invalid address releases the reference
+	skynet.rawsend(0xffffff, "lua", skynet.sharedpack("push", snapshot))
+	collectgarbage()
+
+	print(string.format("send to %d services %d times : copy %.2fms, shared %.2fms", N, ROUND, copy_ti / 1e6, shared_ti / 1e6))
+	print("sharedpack test ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,50 @@
+local skynet = require "skynet"
+
+local mode, arg = ...
+local N = 200
+
+if mode == "agent" then
+
+local inited = false
+skynet.init(function()
+	inited = true
+end)
+
+skynet.start(function()
+	assert(inited)
+	skynet.dispatch("lua", function()
+		skynet.ret(skynet.pack(SERVICE_NAME, arg))
+		skynet.exit()
+	end)
+end)
+
+else
+
+local function spawn(n)
+	local agents = {}
+	local start = skynet.hpc()
+	for i = 1, n do
+		agents[i] = skynet.newservice(SERVICE_NAME, "agent", i)
+	end
+	local ti = skynet.hpc() - start
+	for i = 1, n do
+		local name, arg = skynet.call(agents[i], "lua")
+		assert(name == SERVICE_NAME and tonumber(arg) == i)
+	end
+	return ti / n / 1000
+end
+
+skynet.start(function()
+	local cold = spawn(N)
+	skynet.call(".launcher", "lua", "TEMPLATE", SERVICE_NAME, N)
+	local warm = spawn(N)
+	-- pool is empty now, wait for refill
+	skynet.sleep(100)
+	local refill = spawn(N)
+	skynet.call(".launcher", "lua", "TEMPLATE", SERVICE_NAME, 0)
+	print(string.format("spawn latency : cold %.1fus, warm %.1fus, after refill %.1fus", cold, warm, refill))
+	print("template test ok")
+	skynet.exit()
+end)
+
+end
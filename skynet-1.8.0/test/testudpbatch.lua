@@ -0,0 +1,56 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local PORT = 8767
+local N = 10000
+
+local function netstat(id)
+	for _, info in ipairs(socket.netstat()) do
+		if info.id == id then
+			return info
+		end
+	end
+end
+
+-- returns the datagrams received and the recv calls of the host
+local function test(batch)
+	local recv = 0
+	local host = socket.udp(function(str, from)
+		assert(#str == 16)
+		assert(socket.udp_address(from) == "127.0.0.1")
+		recv = recv + 1
+	end, "127.0.0.1", PORT)
+	if batch then
+		socket.udp_batch(host)
+	end
+
+	local c = socket.udp(function() end)
+	socket.udp_connect(c, "127.0.0.1", PORT)
+	local start = skynet.now()
+	for i = 1, N do
+		socket.write(c, string.format("%016d", i))
+		if i % 100 == 0 then
+			-- give socket thread a chance to drain the receive buffer
+			skynet.yield()
+		end
+	end
+	skynet.sleep(50)
+
+	local rcall = netstat(host).rcall
+	print(string.format("udp batch %s : send %d, recv %d in %d ticks, recv calls = %d",
+		batch, N, recv, skynet.now() - start - 50, rcall))
+	socket.close(c)
+	socket.close(host)
+	return recv, rcall
+end
+
+skynet.start(function()
+	-- one datagram per message by default
+	local recv, rcall = test(false)
+	assert(recv > 0 and rcall == recv)
+
+	recv, rcall = test(true)
+	assert(recv > 0 and rcall < recv)
+	print("udp batch test ok")
+	skynet.exit()
+end)
@@ -0,0 +1,45 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local PORT = 8003
+local N = 200
+
+local function netstat(id)
+	for _, info in ipairs(socket.netstat()) do
+		if info.id == id then
+			return info
+		end
+	end
+end
+
+skynet.start(function()
+	local server
+	local listen_id = socket.listen("127.0.0.1", PORT)
+	socket.start(listen_id, function(id, addr)
+		socket.start(id)
+		server = id
+	end)
+	local client = assert(socket.open("127.0.0.1", PORT))
+	while not server do
+		skynet.sleep(1)
+	end
+
+	-- low priority packages are queued by socket thread, and flushed by writev
+	for i = 1, N do
+		socket.lwrite(server, string.format("%08d", i))
+	end
+	for i = 1, N do
+		local pack = socket.read(client, 8)
+		assert(tonumber(pack) == i, "order mismatch")
+	end
+
+	local info = netstat(server)
+	print(string.format("send %d packages, write bytes = %d, write calls = %d", N, info.write, info.wcall))
+	assert(info.wcall < N)
+
+	socket.close(client)
+	socket.close(server)
+	socket.close(listen_id)
+	print("writev test ok")
+	skynet.exit()
+end)